@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+
+/*
+Невладеющее представление непрерывного участка массива (аналог std::span из C++20).
+Действительно, пока не изменен массив, на который ссылается
+*/
+
+template <typename T>
+class ArrayView {
+public:
+    ArrayView() = default;
+
+    ArrayView(const T* data, size_t size) : data_(data), size_(size) {}
+
+    const T* begin() const {
+        return data_;
+    }
+    const T* end() const {
+        return data_ + size_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+    bool empty() const {
+        return size_ == 0;
+    }
+
+    const T& operator[](size_t index) const {
+        return data_[index];
+    }
+
+private:
+    const T* data_ = nullptr;
+    size_t size_ = 0;
+};
@@ -0,0 +1,447 @@
+#include "batch_processor.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <execution>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+using std::literals::string_literals::operator""s;
+
+namespace {
+
+// Результат команды: найденные документы запроса или сообщение об ошибке
+struct CommandResult {
+    std::vector<Document> documents;
+    std::string error;
+};
+
+/*
+Блок ввода и все, что из него получено на стадиях конвейера.
+Команды ссылаются на block, поэтому блок передается между стадиями только по указателю.
+Строка с ошибкой разбора тоже дает команду - с заполненной ошибкой в results
+*/
+
+struct Batch {
+    std::string block;
+    std::vector<BatchCommand> commands;
+    std::vector<CommandResult> results;
+    std::string output;
+};
+
+using BatchPtr = std::unique_ptr<Batch>;
+
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity)
+        : capacity_(std::max<size_t>(capacity, 1)) {
+    }
+
+    // Ждет свободного места; false - очередь закрыта и значение не принято
+    bool Push(T value) {
+        std::unique_lock lock(mutex_);
+        not_full_.wait(lock, [this] { return closed_ || items_.size() < capacity_; });
+        if (closed_) {
+            return false;
+        }
+        items_.push_back(std::move(value));
+        lock.unlock();
+        not_empty_.notify_one();
+        return true;
+    }
+
+    // Пустой результат - очередь закрыта и все значения разобраны
+    std::optional<T> Pop() {
+        std::unique_lock lock(mutex_);
+        not_empty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+        if (items_.empty()) {
+            return std::nullopt;
+        }
+        T value = std::move(items_.front());
+        items_.pop_front();
+        lock.unlock();
+        not_full_.notify_one();
+        return value;
+    }
+
+    void Close() {
+        {
+            std::lock_guard guard(mutex_);
+            closed_ = true;
+        }
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+
+private:
+    const size_t capacity_;
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::deque<T> items_;
+    bool closed_ = false;
+};
+
+// Следующее слово строки, rest сдвигается за него
+std::string_view NextToken(std::string_view& rest) {
+    rest.remove_prefix(std::min(rest.find_first_not_of(' '), rest.size()));
+    const size_t end = std::min(rest.find(' '), rest.size());
+    const std::string_view token = rest.substr(0, end);
+    rest.remove_prefix(end);
+    return token;
+}
+
+std::string_view TrimLeft(std::string_view text) {
+    text.remove_prefix(std::min(text.find_first_not_of(' '), text.size()));
+    return text;
+}
+
+int ParseInt(std::string_view text, const std::string& what) {
+    int value = 0;
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (error != std::errc() || end != text.data() + text.size()) {
+        throw std::invalid_argument("Invalid "s + what + " '"s + std::string(text) + "'"s);
+    }
+    return value;
+}
+
+DocumentStatus ParseStatus(std::string_view text) {
+    if (text == "actual") {
+        return DocumentStatus::ACTUAL;
+    }
+    if (text == "irrelevant") {
+        return DocumentStatus::IRRELEVANT;
+    }
+    if (text == "banned") {
+        return DocumentStatus::BANNED;
+    }
+    if (text == "removed") {
+        return DocumentStatus::REMOVED;
+    }
+    throw std::invalid_argument("Invalid document status '"s + std::string(text) + "'"s);
+}
+
+std::vector<int> ParseRatings(std::string_view text) {
+    std::vector<int> ratings;
+    if (text == "-") {
+        return ratings;
+    }
+    while (true) {
+        const size_t end = std::min(text.find(','), text.size());
+        ratings.push_back(ParseInt(text.substr(0, end), "rating"s));
+        if (end == text.size()) {
+            return ratings;
+        }
+        text.remove_prefix(end + 1);
+    }
+}
+
+void ParseBlock(Batch& batch, uint64_t& line_number) {
+    std::string_view rest = batch.block;
+    while (!rest.empty()) {
+        const size_t end = std::min(rest.find('\n'), rest.size());
+        std::string_view line = rest.substr(0, end);
+        rest.remove_prefix(std::min(end + 1, rest.size()));
+        ++line_number;
+
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        line = TrimLeft(line);
+        if (line.empty() || line.front() == '#') {
+            continue;
+        }
+        try {
+            batch.commands.push_back(ParseBatchCommand(line, line_number));
+            batch.results.emplace_back();
+        } catch (const std::invalid_argument& e) {
+            BatchCommand command;
+            command.line = line_number;
+            batch.commands.push_back(std::move(command));
+            batch.results.push_back({ {}, e.what() });
+        }
+    }
+}
+
+void ExecuteBatch(SearchServer& search_server, Batch& batch) {
+    const std::vector<BatchCommand>& commands = batch.commands;
+    std::vector<CommandResult>& results = batch.results;
+    // Номера команд серии запросов: по ним параллельный обход обращается к обоим массивам
+    std::vector<size_t> indexes;
+
+    size_t begin = 0;
+    while (begin < commands.size()) {
+        // Запросы между изменениями индекса (и уже неудачные команды) выполняются параллельно
+        size_t end = begin;
+        while (end < commands.size() && (commands[end].type == BatchCommandType::QUERY || !results[end].error.empty())) {
+            ++end;
+        }
+        if (end > begin) {
+            indexes.resize(end - begin);
+            std::iota(indexes.begin(), indexes.end(), begin);
+            std::for_each(std::execution::par, indexes.begin(), indexes.end(),
+                          [&search_server, &commands, &results](size_t index) {
+                              CommandResult& result = results[index];
+                              if (!result.error.empty()) {
+                                  return;
+                              }
+                              try {
+                                  result.documents = search_server.FindTopDocuments(commands[index].text);
+                              } catch (const std::exception& e) {
+                                  result.error = e.what();
+                              }
+                          });
+            begin = end;
+            continue;
+        }
+
+        const BatchCommand& command = commands[begin];
+        try {
+            if (command.type == BatchCommandType::ADD) {
+                search_server.AddDocument(command.document_id, command.text, command.status, command.ratings);
+            } else {
+                search_server.RemoveDocument(command.document_id);
+            }
+        } catch (const std::exception& e) {
+            results[begin].error = e.what();
+        }
+        ++begin;
+    }
+}
+
+void FormatBatch(Batch& batch, BatchStats& stats) {
+    std::string& output = batch.output;
+    char buffer[32];
+    auto append_number = [&output, &buffer](auto value) {
+        const auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        output.append(buffer, end);
+    };
+
+    for (size_t i = 0; i < batch.commands.size(); ++i) {
+        const BatchCommand& command = batch.commands[i];
+        const CommandResult& result = batch.results[i];
+        if (!result.error.empty()) {
+            ++stats.errors;
+            append_number(command.line);
+            output += "\terror: "s;
+            output += result.error;
+            output.push_back('\n');
+            continue;
+        }
+
+        if (command.type == BatchCommandType::ADD) {
+            ++stats.added;
+        } else if (command.type == BatchCommandType::REMOVE) {
+            ++stats.removed;
+        } else {
+            ++stats.queries;
+            append_number(command.line);
+            output.push_back('\t');
+            for (size_t j = 0; j < result.documents.size(); ++j) {
+                if (j > 0) {
+                    output.push_back(' ');
+                }
+                append_number(result.documents[j].id);
+                output.push_back(':');
+                append_number(result.documents[j].relevance);
+            }
+            output.push_back('\n');
+        }
+    }
+}
+
+} // namespace
+
+BatchCommand ParseBatchCommand(std::string_view line, uint64_t line_number) {
+    BatchCommand command;
+    command.line = line_number;
+    std::string_view rest = line;
+    const std::string_view name = NextToken(rest);
+
+    if (name == "query") {
+        command.type = BatchCommandType::QUERY;
+        command.text = TrimLeft(rest);
+    } else if (name == "add") {
+        command.type = BatchCommandType::ADD;
+        command.document_id = ParseInt(NextToken(rest), "document id"s);
+        command.status = ParseStatus(NextToken(rest));
+        command.ratings = ParseRatings(NextToken(rest));
+        command.text = TrimLeft(rest);
+    } else if (name == "remove") {
+        command.type = BatchCommandType::REMOVE;
+        command.document_id = ParseInt(NextToken(rest), "document id"s);
+        if (!NextToken(rest).empty()) {
+            throw std::invalid_argument("Unexpected argument of remove"s);
+        }
+    } else {
+        throw std::invalid_argument("Unknown command '"s + std::string(name) + "'"s);
+    }
+    return command;
+}
+
+BatchStats RunBatch(SearchServer& search_server, std::FILE* input, std::FILE* output, const BatchConfig& config) {
+    const auto start = std::chrono::steady_clock::now();
+    LineBlockReader reader(input, config.block_size);
+    BoundedQueue<BatchPtr> read_batches(config.queue_depth);
+    BoundedQueue<BatchPtr> parsed_batches(config.queue_depth);
+    BoundedQueue<BatchPtr> executed_batches(config.queue_depth);
+
+    // Первая ошибка любой стадии останавливает конвейер и пробрасывается вызывающему
+    std::mutex failure_mutex;
+    std::exception_ptr failure;
+    auto fail = [&] {
+        {
+            std::lock_guard guard(failure_mutex);
+            if (!failure) {
+                failure = std::current_exception();
+            }
+        }
+        read_batches.Close();
+        parsed_batches.Close();
+        executed_batches.Close();
+    };
+
+    BatchStats stats;
+    std::thread parser([&] {
+        try {
+            uint64_t line_number = 0;
+            while (std::optional<BatchPtr> batch = read_batches.Pop()) {
+                ParseBlock(**batch, line_number);
+                if (!parsed_batches.Push(std::move(*batch))) {
+                    break;
+                }
+            }
+            stats.lines = line_number;
+        } catch (...) {
+            fail();
+        }
+        parsed_batches.Close();
+    });
+    std::thread executor([&] {
+        try {
+            while (std::optional<BatchPtr> batch = parsed_batches.Pop()) {
+                ExecuteBatch(search_server, **batch);
+                if (!executed_batches.Push(std::move(*batch))) {
+                    break;
+                }
+            }
+        } catch (...) {
+            fail();
+        }
+        executed_batches.Close();
+    });
+    // Блоки приходят в порядке ввода, поэтому и результаты пишутся в нем же
+    std::thread writer([&] {
+        try {
+            while (std::optional<BatchPtr> batch = executed_batches.Pop()) {
+                FormatBatch(**batch, stats);
+                const std::string& text = (*batch)->output;
+                if (std::fwrite(text.data(), 1, text.size(), output) != text.size()) {
+                    throw std::runtime_error("Failed to write output"s);
+                }
+            }
+            if (std::fflush(output) != 0) {
+                throw std::runtime_error("Failed to write output"s);
+            }
+        } catch (...) {
+            fail();
+        }
+    });
+
+    try {
+        while (true) {
+            BatchPtr batch = std::make_unique<Batch>();
+            if (!reader.ReadBlock(batch->block) || !read_batches.Push(std::move(batch))) {
+                break;
+            }
+        }
+    } catch (...) {
+        fail();
+    }
+    read_batches.Close();
+    parser.join();
+    executor.join();
+    writer.join();
+
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+int RunBatchTool(const std::vector<std::string>& args) {
+    BatchConfig config;
+    std::string input_path;
+    std::string output_path;
+    std::string stop_words;
+
+    try {
+        for (size_t i = 0; i < args.size(); ++i) {
+            const std::string& key = args[i];
+            if (i + 1 >= args.size()) {
+                throw std::invalid_argument("Missing value for "s + key);
+            }
+            const std::string& value = args[++i];
+            if (key == "--input"s) {
+                input_path = value;
+            } else if (key == "--output"s) {
+                output_path = value;
+            } else if (key == "--stop-words"s) {
+                stop_words = value;
+            } else if (key == "--block-size"s) {
+                config.block_size = std::stoull(value);
+            } else if (key == "--queue-depth"s) {
+                config.queue_depth = std::stoull(value);
+            } else {
+                throw std::invalid_argument("Unknown option "s + key);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << "Usage: batch [--input FILE] [--output FILE] [--stop-words WORDS]"s
+                  << " [--block-size BYTES] [--queue-depth N]"s << std::endl;
+        return 2;
+    }
+
+    using File = std::unique_ptr<std::FILE, int (*)(std::FILE*)>;
+    File input_file(nullptr, &std::fclose);
+    File output_file(nullptr, &std::fclose);
+    if (!input_path.empty()) {
+        input_file.reset(std::fopen(input_path.c_str(), "rb"));
+        if (!input_file) {
+            std::cerr << "Cannot open "s << input_path << std::endl;
+            return 1;
+        }
+    }
+    if (!output_path.empty()) {
+        output_file.reset(std::fopen(output_path.c_str(), "wb"));
+        if (!output_file) {
+            std::cerr << "Cannot open "s << output_path << std::endl;
+            return 1;
+        }
+    }
+
+    try {
+        SearchServer search_server(stop_words);
+        const BatchStats stats = RunBatch(search_server, input_file ? input_file.get() : stdin,
+                                          output_file ? output_file.get() : stdout, config);
+        std::cerr << stats.lines << " lines: "s << stats.queries << " queries, "s << stats.added << " added, "s
+                  << stats.removed << " removed, "s << stats.errors << " errors in "s << stats.seconds << " s ("s
+                  << static_cast<uint64_t>(stats.lines / std::max(stats.seconds, 1e-9)) << " lines/s)"s << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "document.h"
+#include "read_input_functions.h"
+#include "search_server.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+Пакетная обработка команд, по одной в строке:
+    add ID STATUS RATINGS TEXT - добавить документ; STATUS - actual|irrelevant|banned|removed,
+                                 RATINGS - рейтинги через запятую или "-", если их нет
+    remove ID                  - удалить документ
+    query TEXT                 - найти лучшие документы (FindTopDocuments)
+Пустые строки и строки, начинающиеся с '#', пропускаются.
+На каждый запрос выводится строка "НОМЕР_СТРОКИ\tID:РЕЛЕВАНТНОСТЬ ...",
+на каждую неудачную команду - "НОМЕР_СТРОКИ\terror: СООБЩЕНИЕ". Вывод идет в порядке ввода
+*/
+
+enum class BatchCommandType { ADD, REMOVE, QUERY };
+
+// Разобранная команда: text ссылается на блок ввода, из которого она разобрана
+struct BatchCommand {
+    BatchCommandType type = BatchCommandType::QUERY;
+    uint64_t line = 0;
+    int document_id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+    std::string_view text;
+};
+
+// Разбор строки без перевода строки; некорректная команда - std::invalid_argument
+BatchCommand ParseBatchCommand(std::string_view line, uint64_t line_number);
+
+struct BatchConfig {
+    size_t block_size = LineBlockReader::DEFAULT_BLOCK_SIZE;
+    // Сколько блоков может ждать между соседними стадиями конвейера
+    size_t queue_depth = 4;
+};
+
+struct BatchStats {
+    uint64_t lines = 0;
+    uint64_t queries = 0;
+    uint64_t added = 0;
+    uint64_t removed = 0;
+    uint64_t errors = 0;
+    double seconds = 0.0;
+};
+
+/*
+Обработка потока команд конвейером из четырех стадий в отдельных потоках:
+чтение блоков -> разбор -> выполнение -> форматирование и запись.
+Стадии обмениваются целыми блоками через ограниченные очереди, поэтому чтение и разбор
+следующих блоков идут одновременно с выполнением текущего, а память ограничена
+queue_depth блоками на стадию. Подряд идущие запросы выполняются параллельно,
+add и remove - по одному в порядке ввода, так что каждый запрос видит все предыдущие изменения
+*/
+
+BatchStats RunBatch(SearchServer& search_server, std::FILE* input, std::FILE* output,
+                    const BatchConfig& config = {});
+
+/*
+Точка входа командной строки:
+batch [--input FILE] [--output FILE] [--stop-words "и в на"] [--block-size BYTES] [--queue-depth N]
+По умолчанию команды читаются из стандартного ввода, результаты пишутся в стандартный вывод
+*/
+
+int RunBatchTool(const std::vector<std::string>& args);
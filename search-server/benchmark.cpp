@@ -0,0 +1,670 @@
+#include "benchmark.h"
+
+#include "document.h"
+#include "search_server.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "paginator.h"
+#include "string_processing.h"
+#include "concurrent_map.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <execution>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+
+#include <sys/resource.h>
+
+using std::literals::string_literals::operator""s;
+
+long PeakRssKb() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    // В Linux ru_maxrss измеряется в килобайтах
+    return usage.ru_maxrss;
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Предел обращений в микротесте словарей (~20 МБ ключей): на больших масштабах
+// он иначе занял бы гигабайты и вытеснил основные замеры
+constexpr size_t MAX_ACCUMULATE_KEYS = 5'000'000;
+
+/*
+Замеры одного теста, накопленные по всем повторениям
+*/
+
+class Samples {
+public:
+    template <typename Function>
+    void Measure(Function function, uint64_t items = 1) {
+        const auto start = Clock::now();
+        function();
+        const auto duration = Clock::now() - start;
+
+        durations_us_.push_back(std::chrono::duration<double, std::micro>(duration).count());
+        total_seconds_ += std::chrono::duration<double>(duration).count();
+        items_ += items;
+    }
+
+    BenchmarkResult Finish(const std::string& name, size_t scale) const {
+        BenchmarkResult result;
+        result.name = name;
+        result.scale = scale;
+        result.operations = durations_us_.size();
+        result.items = items_;
+        result.total_seconds = total_seconds_;
+        if (total_seconds_ > 0) {
+            result.throughput = items_ / total_seconds_;
+        }
+
+        std::vector<double> sorted = durations_us_;
+        std::sort(sorted.begin(), sorted.end());
+        auto percentile = [&sorted](double p) {
+            if (sorted.empty()) {
+                return 0.0;
+            }
+            const size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+            return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+        };
+        result.p50_us = percentile(0.5);
+        result.p90_us = percentile(0.9);
+        result.p99_us = percentile(0.99);
+        result.max_us = percentile(1.0);
+
+        return result;
+    }
+
+private:
+    std::vector<double> durations_us_;
+    uint64_t items_ = 0;
+    double total_seconds_ = 0.0;
+};
+
+// Тесты в порядке первого запуска, чтобы отчет читался сверху вниз
+class SampleSet {
+public:
+    Samples& operator[](const std::string& name) {
+        auto [it, inserted] = samples_.try_emplace(name);
+        if (inserted) {
+            order_.push_back(name);
+        }
+        return it->second;
+    }
+
+    void AppendResults(size_t scale, std::vector<BenchmarkResult>& results) const {
+        for (const std::string& name : order_) {
+            results.push_back(samples_.at(name).Finish(name, scale));
+        }
+    }
+
+private:
+    std::map<std::string, Samples> samples_;
+    std::vector<std::string> order_;
+};
+
+// Поток, отбрасывающий вывод (RemoveDuplicates печатает найденные дубликаты)
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override {
+        return c;
+    }
+};
+
+DocumentStatus StatusForDocument(size_t index) {
+    // Большая часть документов актуальна, остальные распределены по прочим статусам
+    switch (index % 10) {
+    case 7:
+        return DocumentStatus::IRRELEVANT;
+    case 8:
+        return DocumentStatus::BANNED;
+    case 9:
+        return DocumentStatus::REMOVED;
+    default:
+        return DocumentStatus::ACTUAL;
+    }
+}
+
+template <typename ExecutionPolicy>
+void RunQueries(const SearchServer& search_server, const std::vector<std::string>& queries,
+                ExecutionPolicy&& policy, Samples* samples) {
+    for (const std::string& query : queries) {
+        auto run = [&] {
+            search_server.FindTopDocuments(policy, query);
+        };
+        if (samples != nullptr) {
+            samples->Measure(run);
+        } else {
+            run();
+        }
+    }
+}
+
+/*
+Прежняя реализация ConcurrentMap - подсловари std::map под мьютексами.
+Оставлена как точка отсчета для сравнения с хеш-таблицей с открытой адресацией
+*/
+
+template <typename Key, typename Value>
+class MutexBucketMap {
+public:
+    explicit MutexBucketMap(size_t bucket_count) : buckets_(bucket_count) {}
+
+    void Add(const Key& key, const Value& delta) {
+        Bucket& bucket = buckets_[static_cast<uint64_t>(key) % buckets_.size()];
+        std::lock_guard guard(bucket.mutex);
+        bucket.data[key] += delta;
+    }
+
+    std::map<Key, Value> BuildOrdinaryMap() {
+        std::map<Key, Value> result;
+        for (auto& [mutex, data] : buckets_) {
+            std::lock_guard guard(mutex);
+            result.insert(data.begin(), data.end());
+        }
+        return result;
+    }
+
+private:
+    struct Bucket {
+        std::mutex mutex;
+        std::map<Key, Value> data;
+    };
+
+    std::vector<Bucket> buckets_;
+};
+
+// Префиксный запрос из первого слова запроса: не больше трех первых букв и звездочка
+std::string MakePrefix(const std::string& query) {
+    std::string_view word = SplitIntoWords(query).front();
+    if (word[0] == '-') {
+        word.remove_prefix(1);
+    }
+    return std::string(word.substr(0, 3)) + '*';
+}
+
+// Тот же запрос в режиме "все слова": каждое плюс-слово становится обязательным
+std::string MakeConjunctive(const std::string& query) {
+    std::string result;
+    for (std::string_view word : SplitIntoWords(query)) {
+        if (!result.empty()) {
+            result += ' ';
+        }
+        if (word[0] != '-') {
+            result += '+';
+        }
+        result += word;
+    }
+    return result;
+}
+
+void RunScale(const BenchmarkConfig& config, size_t scale, std::vector<BenchmarkResult>& results,
+              std::ostream& log) {
+    CorpusConfig corpus_config = config.corpus;
+    corpus_config.document_count = scale;
+    ZipfCorpusGenerator generator(corpus_config);
+
+    log << "Generating corpus of "s << scale << " documents"s << std::endl;
+    const std::vector<std::string> documents = generator.GenerateDocuments(scale);
+    const std::vector<std::string> queries = generator.GenerateQueries(config.query_count);
+    std::vector<std::string> conjunctive_queries;
+    std::vector<std::string> prefix_queries;
+    conjunctive_queries.reserve(queries.size());
+    prefix_queries.reserve(queries.size());
+    for (const std::string& query : queries) {
+        conjunctive_queries.push_back(MakeConjunctive(query));
+        prefix_queries.push_back(MakePrefix(query));
+    }
+    std::vector<std::vector<int>> ratings(scale);
+    for (auto& document_ratings : ratings) {
+        document_ratings = generator.GenerateRatings();
+    }
+
+    // Самые частые слова распределения Ципфа играют роль стоп-слов
+    const auto& vocabulary = generator.GetVocabulary();
+    const std::vector<std::string> stop_words(vocabulary.begin(),
+                                              vocabulary.begin() + std::min<size_t>(10, vocabulary.size()));
+
+    // Ключи микротеста словарей: по 50 обращений на документ в псевдослучайном порядке
+    std::vector<int> accumulate_keys(std::min(scale * 50, MAX_ACCUMULATE_KEYS));
+    for (size_t i = 0; i < accumulate_keys.size(); ++i) {
+        accumulate_keys[i] = static_cast<int>(i * 7919 % scale);
+    }
+
+    SampleSet samples;
+    for (int repetition = 0; repetition < config.repetitions; ++repetition) {
+        log << "  repetition "s << repetition + 1 << "/"s << config.repetitions << std::endl;
+        SearchServer search_server(stop_words);
+
+        {
+            // Параллельное накопление значений по ключам, как при подсчете релевантности
+            samples["map_accumulate_mutex"s].Measure([&] {
+                MutexBucketMap<int, double> map(100);
+                std::for_each(std::execution::par, accumulate_keys.begin(), accumulate_keys.end(), [&map](int key) {
+                    map.Add(key, 1.0);
+                });
+                map.BuildOrdinaryMap();
+            }, accumulate_keys.size());
+
+            // Без подсказки о размере таблицы сегментов растут во время накопления
+            samples["map_accumulate_open"s].Measure([&] {
+                ConcurrentMap<int, double> map;
+                std::for_each(std::execution::par, accumulate_keys.begin(), accumulate_keys.end(), [&map](int key) {
+                    map[key] += 1.0;
+                });
+                map.ExtractItems(std::execution::par);
+            }, accumulate_keys.size());
+        }
+
+        for (size_t i = 0; i < documents.size(); ++i) {
+            samples["ingest"s].Measure([&] {
+                search_server.AddDocument(i, documents[i], StatusForDocument(i), ratings[i]);
+            });
+        }
+
+        for (int i = 0; i < config.warmup; ++i) {
+            RunQueries(search_server, queries, std::execution::seq, nullptr);
+        }
+        RunQueries(search_server, queries, std::execution::seq, &samples["find_top_seq"s]);
+        RunQueries(search_server, queries, std::execution::par, &samples["find_top_par"s]);
+        RunQueries(search_server, conjunctive_queries, std::execution::seq, &samples["find_top_all_seq"s]);
+        RunQueries(search_server, conjunctive_queries, std::execution::par, &samples["find_top_all_par"s]);
+        RunQueries(search_server, prefix_queries, std::execution::seq, &samples["find_top_prefix"s]);
+
+        {
+            // Те же запросы на движке с индексом вкладов
+            IndexOptions impact_options;
+            impact_options.engine = RankingEngine::IMPACT_ORDERED;
+            SearchServer impact_server(stop_words, impact_options);
+            for (size_t i = 0; i < documents.size(); ++i) {
+                samples["ingest_impact"s].Measure([&] {
+                    impact_server.AddDocument(i, documents[i], StatusForDocument(i), ratings[i]);
+                });
+            }
+            RunQueries(impact_server, queries, std::execution::seq, &samples["find_top_impact"s]);
+        }
+
+        for (size_t i = 0; i < queries.size(); ++i) {
+            const int document_id = static_cast<int>(i * 7919 % documents.size());
+            samples["match_seq"s].Measure([&] {
+                search_server.MatchDocument(std::execution::seq, queries[i], document_id);
+            });
+            samples["match_par"s].Measure([&] {
+                search_server.MatchDocument(std::execution::par, queries[i], document_id);
+            });
+        }
+
+        // Подсветка страницы результатов: 20 документов на запрос одним вызовом
+        for (size_t i = 0; i < queries.size(); ++i) {
+            std::vector<int> document_ids;
+            for (size_t j = 0; j < 20; ++j) {
+                document_ids.push_back(static_cast<int>((i * 7919 + j * 104729) % documents.size()));
+            }
+            samples["match_batch_seq"s].Measure([&] {
+                search_server.MatchDocuments(std::execution::seq, queries[i], document_ids);
+            }, document_ids.size());
+            samples["match_batch_par"s].Measure([&] {
+                search_server.MatchDocuments(std::execution::par, queries[i], document_ids);
+            }, document_ids.size());
+        }
+
+        // Опрос отчета о памяти, как это делает экспортер метрик
+        for (int i = 0; i < 10; ++i) {
+            samples["memory_report"s].Measure([&] {
+                search_server.GetMemoryReport();
+            });
+        }
+
+        std::vector<Document> joined;
+        samples["process_queries"s].Measure([&] {
+            ProcessQueries(search_server, queries);
+        }, queries.size());
+        samples["process_queries_joined"s].Measure([&] {
+            joined = ProcessQueriesJoined(search_server, queries);
+        }, queries.size());
+
+        if (!joined.empty()) {
+            for (int i = 0; i < 100; ++i) {
+                samples["paginate"s].Measure([&] {
+                    Paginate(joined, config.page_size);
+                }, joined.size());
+            }
+        }
+
+        // Глубокая постраничная выдача по курсору: до 20 страниц на запрос
+        for (size_t i = 0; i < std::min<size_t>(queries.size(), 100); ++i) {
+            size_t pages = 0;
+            samples["paginate_search"s].Measure([&] {
+                const auto paginator = PaginateSearch(search_server, queries[i], config.page_size);
+                for (auto it = paginator.begin(); it != paginator.end() && pages < 20; ++it) {
+                    ++pages;
+                }
+            });
+        }
+
+        {
+            NullBuffer null_buffer;
+            std::streambuf* const cout_buffer = std::cout.rdbuf(&null_buffer);
+            samples["remove_duplicates"s].Measure([&] {
+                RemoveDuplicates(search_server);
+            }, search_server.GetDocumentCount());
+            std::cout.rdbuf(cout_buffer);
+        }
+
+        // Удаляем равномерно распределенные по индексу документы, половину каждой политикой
+        const size_t remove_count = static_cast<size_t>(search_server.GetDocumentCount() * config.remove_fraction);
+        std::vector<int> remove_ids;
+        if (remove_count > 0) {
+            const size_t stride = std::max<size_t>(1, search_server.GetDocumentCount() / remove_count);
+            size_t position = 0;
+            for (const int document_id : search_server) {
+                if (position++ % stride == 0 && remove_ids.size() < remove_count) {
+                    remove_ids.push_back(document_id);
+                }
+            }
+        }
+        for (size_t i = 0; i < remove_ids.size(); ++i) {
+            if (i % 2 == 0) {
+                samples["remove_seq"s].Measure([&] {
+                    search_server.RemoveDocument(std::execution::seq, remove_ids[i]);
+                });
+            } else {
+                samples["remove_par"s].Measure([&] {
+                    search_server.RemoveDocument(std::execution::par, remove_ids[i]);
+                });
+            }
+        }
+    }
+
+    samples.AppendResults(scale, results);
+}
+
+/*
+Минимальный разбор JSON, записанного WriteBenchmarkJson: плоские объекты в массиве "results"
+*/
+
+class JsonReader {
+public:
+    explicit JsonReader(std::string text) : text_(std::move(text)) {}
+
+    std::vector<BenchmarkResult> ReadResults() {
+        const size_t key = text_.find("\"results\""s);
+        if (key == std::string::npos) {
+            throw std::invalid_argument("Benchmark JSON has no results"s);
+        }
+        position_ = key + 9;
+        Expect(':');
+        Expect('[');
+
+        std::vector<BenchmarkResult> results;
+        SkipSpaces();
+        if (Peek() == ']') {
+            return results;
+        }
+        while (true) {
+            results.push_back(ReadResult());
+            SkipSpaces();
+            if (Peek() == ',') {
+                ++position_;
+                continue;
+            }
+            Expect(']');
+            return results;
+        }
+    }
+
+private:
+    std::string text_;
+    size_t position_ = 0;
+
+    void SkipSpaces() {
+        while (position_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[position_]))) {
+            ++position_;
+        }
+    }
+
+    char Peek() {
+        SkipSpaces();
+        if (position_ >= text_.size()) {
+            throw std::invalid_argument("Unexpected end of benchmark JSON"s);
+        }
+        return text_[position_];
+    }
+
+    void Expect(char c) {
+        if (Peek() != c) {
+            throw std::invalid_argument("Malformed benchmark JSON: expected "s + c);
+        }
+        ++position_;
+    }
+
+    std::string ReadString() {
+        Expect('"');
+        std::string result;
+        while (position_ < text_.size() && text_[position_] != '"') {
+            if (text_[position_] == '\\') {
+                ++position_;
+            }
+            result.push_back(text_[position_++]);
+        }
+        Expect('"');
+        return result;
+    }
+
+    double ReadNumber() {
+        SkipSpaces();
+        size_t length = 0;
+        const double value = std::stod(text_.substr(position_, 32), &length);
+        position_ += length;
+        return value;
+    }
+
+    BenchmarkResult ReadResult() {
+        BenchmarkResult result;
+        Expect('{');
+        while (Peek() != '}') {
+            const std::string key = ReadString();
+            Expect(':');
+            if (key == "name"s) {
+                result.name = ReadString();
+            } else {
+                const double value = ReadNumber();
+                if (key == "scale"s) {
+                    result.scale = static_cast<size_t>(value);
+                } else if (key == "operations"s) {
+                    result.operations = static_cast<uint64_t>(value);
+                } else if (key == "items"s) {
+                    result.items = static_cast<uint64_t>(value);
+                } else if (key == "total_seconds"s) {
+                    result.total_seconds = value;
+                } else if (key == "throughput"s) {
+                    result.throughput = value;
+                } else if (key == "p50_us"s) {
+                    result.p50_us = value;
+                } else if (key == "p90_us"s) {
+                    result.p90_us = value;
+                } else if (key == "p99_us"s) {
+                    result.p99_us = value;
+                } else if (key == "max_us"s) {
+                    result.max_us = value;
+                }
+            }
+            if (Peek() == ',') {
+                ++position_;
+            }
+        }
+        Expect('}');
+        return result;
+    }
+};
+
+std::vector<size_t> ParseScales(const std::string& text) {
+    std::vector<size_t> scales;
+    std::istringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        scales.push_back(std::stoull(item));
+    }
+    return scales;
+}
+
+} // namespace
+
+std::vector<BenchmarkResult> RunBenchmarks(const BenchmarkConfig& config, std::ostream& log) {
+    std::vector<BenchmarkResult> results;
+    for (const size_t scale : config.scales) {
+        RunScale(config, scale, results, log);
+    }
+    return results;
+}
+
+void WriteBenchmarkJson(std::ostream& out, const BenchmarkConfig& config,
+                        const std::vector<BenchmarkResult>& results) {
+    const auto precision = out.precision(10);
+
+    out << "{\n  \"config\": {"s
+        << "\"seed\": "s << config.corpus.seed
+        << ", \"vocabulary_size\": "s << config.corpus.vocabulary_size
+        << ", \"query_count\": "s << config.query_count
+        << ", \"warmup\": "s << config.warmup
+        << ", \"repetitions\": "s << config.repetitions << "},\n"s;
+    out << "  \"peak_rss_kb\": "s << PeakRssKb() << ",\n"s;
+
+    out << "  \"results\": ["s;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& result = results[i];
+        out << (i == 0 ? "\n"s : ",\n"s)
+            << "    {\"name\": \""s << result.name << "\""s
+            << ", \"scale\": "s << result.scale
+            << ", \"operations\": "s << result.operations
+            << ", \"items\": "s << result.items
+            << ", \"total_seconds\": "s << result.total_seconds
+            << ", \"throughput\": "s << result.throughput
+            << ", \"p50_us\": "s << result.p50_us
+            << ", \"p90_us\": "s << result.p90_us
+            << ", \"p99_us\": "s << result.p99_us
+            << ", \"max_us\": "s << result.max_us << "}"s;
+    }
+    out << "\n  ]\n}\n"s;
+
+    out.precision(precision);
+}
+
+std::vector<BenchmarkResult> ReadBenchmarkJson(std::istream& in) {
+    std::ostringstream text;
+    text << in.rdbuf();
+    return JsonReader(text.str()).ReadResults();
+}
+
+int CompareBenchmarks(const std::vector<BenchmarkResult>& baseline,
+                      const std::vector<BenchmarkResult>& current,
+                      double threshold, std::ostream& out) {
+    std::map<std::pair<std::string, size_t>, const BenchmarkResult*> baseline_index;
+    for (const BenchmarkResult& result : baseline) {
+        baseline_index[{ result.name, result.scale }] = &result;
+    }
+
+    // Относительное изменение: положительное значение - ухудшение
+    auto change = [](double before, double after) {
+        return before > 0 ? (after - before) / before : 0.0;
+    };
+
+    int regressions = 0;
+    out << std::fixed << std::setprecision(1);
+    for (const BenchmarkResult& result : current) {
+        const auto it = baseline_index.find({ result.name, result.scale });
+        if (it == baseline_index.end()) {
+            out << result.name << " @"s << result.scale << ": no baseline"s << std::endl;
+            continue;
+        }
+        const BenchmarkResult& before = *it->second;
+        const double p50_change = change(before.p50_us, result.p50_us);
+        const double p99_change = change(before.p99_us, result.p99_us);
+        const double throughput_change = -change(before.throughput, result.throughput);
+
+        const bool regression = p50_change > threshold || p99_change > threshold || throughput_change > threshold;
+        regressions += regression;
+
+        out << (regression ? "REGRESSION "s : "ok         "s)
+            << result.name << " @"s << result.scale
+            << ": p50 "s << p50_change * 100 << "%, p99 "s << p99_change * 100
+            << "%, throughput "s << -throughput_change * 100 << "%"s << std::endl;
+    }
+    out << std::defaultfloat;
+
+    return regressions;
+}
+
+int RunBenchmarkTool(const std::vector<std::string>& args) {
+    BenchmarkConfig config;
+    std::string out_path;
+    std::string baseline_path;
+    double threshold = 0.1;
+
+    try {
+        for (size_t i = 0; i < args.size(); ++i) {
+            const std::string& key = args[i];
+            if (i + 1 >= args.size()) {
+                throw std::invalid_argument("Missing value for "s + key);
+            }
+            const std::string& value = args[++i];
+            if (key == "--scales"s) {
+                config.scales = ParseScales(value);
+            } else if (key == "--queries"s) {
+                config.query_count = std::stoull(value);
+            } else if (key == "--warmup"s) {
+                config.warmup = std::stoi(value);
+            } else if (key == "--reps"s) {
+                config.repetitions = std::stoi(value);
+            } else if (key == "--seed"s) {
+                config.corpus.seed = std::stoull(value);
+            } else if (key == "--vocabulary"s) {
+                config.corpus.vocabulary_size = std::stoull(value);
+            } else if (key == "--out"s) {
+                out_path = value;
+            } else if (key == "--baseline"s) {
+                baseline_path = value;
+            } else if (key == "--threshold"s) {
+                threshold = std::stod(value);
+            } else {
+                throw std::invalid_argument("Unknown option "s + key);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << "Usage: bench [--scales N,N] [--queries N] [--warmup N] [--reps N] [--seed N]"s
+                  << " [--vocabulary N] [--out FILE] [--baseline FILE] [--threshold X]"s << std::endl;
+        return 2;
+    }
+
+    const std::vector<BenchmarkResult> results = RunBenchmarks(config, std::cerr);
+
+    if (out_path.empty()) {
+        WriteBenchmarkJson(std::cout, config, results);
+    } else {
+        std::ofstream out(out_path);
+        WriteBenchmarkJson(out, config, results);
+    }
+
+    if (baseline_path.empty()) {
+        return 0;
+    }
+    std::ifstream baseline_file(baseline_path);
+    if (!baseline_file) {
+        std::cerr << "Cannot open baseline "s << baseline_path << std::endl;
+        return 2;
+    }
+    const int regressions = CompareBenchmarks(ReadBenchmarkJson(baseline_file), results, threshold, std::cerr);
+    return regressions > 0 ? 1 : 0;
+}
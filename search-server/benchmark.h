@@ -0,0 +1,76 @@
+#pragma once
+
+#include "corpus_generator.h"
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Параметры набора бенчмарков
+struct BenchmarkConfig {
+    CorpusConfig corpus;
+    // Размеры корпуса (количество документов), на которых выполняются замеры
+    std::vector<size_t> scales = { 10'000, 100'000 };
+    size_t query_count = 1'000;
+    // Прогревочные проходы запросов перед замером
+    int warmup = 1;
+    // Повторения всего набора (с построением индекса заново)
+    int repetitions = 3;
+    // Доля документов, удаляемых в тестах удаления
+    double remove_fraction = 0.01;
+    size_t page_size = 10;
+};
+
+/*
+Результат одного теста на одном размере корпуса.
+Операция - один вызов тестируемой функции, элемент - единица полезной работы
+(для пакетных функций вроде ProcessQueries одна операция обрабатывает много элементов)
+*/
+
+struct BenchmarkResult {
+    std::string name;
+    size_t scale = 0;
+    uint64_t operations = 0;
+    uint64_t items = 0;
+    double total_seconds = 0.0;
+    // Элементов в секунду
+    double throughput = 0.0;
+    // Задержка одной операции
+    double p50_us = 0.0;
+    double p90_us = 0.0;
+    double p99_us = 0.0;
+    double max_us = 0.0;
+};
+
+// Пиковый размер резидентной памяти процесса. Это максимум за все время работы,
+// поэтому он относится ко всему прогону, а не к отдельному тесту
+long PeakRssKb();
+
+std::vector<BenchmarkResult> RunBenchmarks(const BenchmarkConfig& config, std::ostream& log);
+
+void WriteBenchmarkJson(std::ostream& out, const BenchmarkConfig& config,
+                        const std::vector<BenchmarkResult>& results);
+
+// Читает результаты, записанные WriteBenchmarkJson
+std::vector<BenchmarkResult> ReadBenchmarkJson(std::istream& in);
+
+/*
+Сравнение с эталонным прогоном: регрессией считается рост p50 или p99
+либо падение пропускной способности больше чем на threshold (доля).
+Возвращает количество регрессий
+*/
+
+int CompareBenchmarks(const std::vector<BenchmarkResult>& baseline,
+                      const std::vector<BenchmarkResult>& current,
+                      double threshold, std::ostream& out);
+
+/*
+Точка входа командной строки:
+bench [--scales 10000,100000] [--queries N] [--warmup N] [--reps N] [--seed N]
+      [--vocabulary N] [--out results.json] [--baseline baseline.json] [--threshold 0.1]
+Возвращает код завершения процесса (ненулевой при регрессиях)
+*/
+
+int RunBenchmarkTool(const std::vector<std::string>& args);
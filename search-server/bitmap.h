@@ -0,0 +1,58 @@
+#pragma once
+
+#include "memory_usage.h"
+
+#include <cstdint>
+#include <vector>
+
+/*
+Плотная битовая карта над порядковыми номерами документов
+*/
+
+class Bitmap {
+public:
+    // Увеличивает размер карты, новые биты сброшены
+    void Resize(size_t size) {
+        size_ = size;
+        words_.resize((size + 63) / 64, 0);
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+
+    void Set(size_t index) {
+        words_[index >> 6] |= uint64_t{1} << (index & 63);
+    }
+
+    void Reset(size_t index) {
+        words_[index >> 6] &= ~(uint64_t{1} << (index & 63));
+    }
+
+    bool Test(size_t index) const {
+        return index < size_ && (words_[index >> 6] >> (index & 63) & 1) != 0;
+    }
+
+    // Количество установленных битов
+    size_t Count() const {
+        size_t result = 0;
+        for (uint64_t word : words_) {
+            result += __builtin_popcountll(word);
+        }
+        return result;
+    }
+
+    MemoryUsage GetMemoryUsage() const {
+        return GetVectorMemoryUsage(words_);
+    }
+
+    // Прирост памяти при Resize(size)
+    size_t GetGrowthBytes(size_t size) const {
+        const size_t word_count = (size + 63) / 64;
+        return word_count > words_.size() ? GetVectorGrowthBytes(words_, word_count - words_.size()) : 0;
+    }
+
+private:
+    std::vector<uint64_t> words_;
+    size_t size_ = 0;
+};
@@ -1,58 +1,393 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <cstdlib>
-#include <future>
+#include <execution>
+#include <functional>
 #include <map>
+#include <memory>
+#include <new>
+#include <numeric>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 using namespace std::string_literals;
 
-template <typename Key, typename Value>
+// Выравнивание ячейки словаря: степень двойки не меньше ее размера, но не больше кеш-линии
+constexpr size_t GetSlotAlignment(size_t size, size_t alignment) {
+    while (alignment < size && alignment < 64) {
+        alignment *= 2;
+    }
+    return alignment;
+}
+
+/*
+Словарь для параллельного накопления значений по ключам.
+Ключи распределены по сегментам, каждый сегмент - хеш-таблица с открытой адресацией
+и линейным пробированием. Вставка ключа и изменение значения выполняются без блокировок:
+ячейка захватывается CAS по ее состоянию, значение обновляется CAS-циклом (в том числе
+сложение для double, у которого нет атомарного fetch_add). Операция только отмечается
+в счетчике активных операций сегмента; увеличение таблицы поднимает флаг сегмента,
+дожидается завершения начатых операций и переносит ячейки, новые операции ждут снятия флага.
+Значение должно быть тривиально копируемым, ключ - хешируемым и сравнимым на равенство
+*/
+
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
 class ConcurrentMap {
+public:
+    static_assert(std::is_trivially_copyable_v<Value>, "ConcurrentMap values must be trivially copyable");
+
+    // Доступ к значению ключа. Ссылку на ячейку не хранит: ячейка может переехать при росте таблицы
+    class Access {
+    public:
+        Access(ConcurrentMap& map, const Key& key) : map_(map), key_(key) {}
+
+        Access& operator+=(const Value& delta) {
+            map_.Update(key_, [&delta](Value value) {
+                return value + delta;
+            });
+            return *this;
+        }
+
+        Access& operator-=(const Value& delta) {
+            map_.Update(key_, [&delta](Value value) {
+                return value - delta;
+            });
+            return *this;
+        }
+
+        Access& operator=(const Value& value) {
+            map_.Update(key_, [&value](Value) {
+                return value;
+            });
+            return *this;
+        }
+
+    private:
+        ConcurrentMap& map_;
+        Key key_;
+    };
+
+    // Количество сегментов округляется вверх до степени двойки
+    explicit ConcurrentMap(size_t shard_count = DEFAULT_SHARD_COUNT, size_t expected_size = 0) {
+        size_t count = 1;
+        while (count < shard_count) {
+            count *= 2;
+            ++shard_bits_;
+        }
+        shards_ = std::vector<Shard>(count);
+        // Начальная емкость рассчитана на expected_size ключей без увеличения таблиц
+        size_t capacity = MIN_CAPACITY;
+        while (capacity * MAX_LOAD_NUMERATOR < expected_size / count * MAX_LOAD_DENOMINATOR) {
+            capacity *= 2;
+        }
+        for (Shard& shard : shards_) {
+            shard.Allocate(capacity);
+        }
+    }
+
+    ConcurrentMap(const ConcurrentMap&) = delete;
+    ConcurrentMap& operator=(const ConcurrentMap&) = delete;
+
+    Access operator[](const Key& key) {
+        return { *this, key };
+    }
+
+    // Атомарная замена значения ключа на function(value); отсутствующий ключ вставляется
+    // со значением Value{}. function может вызываться несколько раз при конкурентных изменениях
+    template <typename Function>
+    void Update(const Key& key, Function function) {
+        const uint64_t hash = MixHash(hasher_(key));
+        Shard& shard = shards_[hash & (shards_.size() - 1)];
+        while (true) {
+            size_t capacity = 0;
+            {
+                const ShardAccess access(shard);
+                if (Slot* slot = shard.FindOrInsert(key, hash >> shard_bits_)) {
+                    Value expected = slot->value.load(std::memory_order_relaxed);
+                    while (!slot->value.compare_exchange_weak(expected, function(expected),
+                                                              std::memory_order_relaxed)) {
+                    }
+                    return;
+                }
+                capacity = shard.capacity;
+            }
+            Grow(shard, capacity);
+        }
+    }
+
+    size_t erase(const Key& key) {
+        const uint64_t hash = MixHash(hasher_(key));
+        Shard& shard = shards_[hash & (shards_.size() - 1)];
+        const ShardAccess access(shard);
+        Slot* slot = shard.Find(key, hash >> shard_bits_);
+        uint8_t state = FULL;
+        // Удаленная ячейка остается занятой до следующего увеличения таблицы
+        return slot != nullptr && slot->state.compare_exchange_strong(state, ERASED, std::memory_order_acq_rel);
+    }
+
+    // Обход пар (ключ, значение), сегменты обходятся параллельно при параллельной политике.
+    // Конкурентные изменения во время обхода могут быть видны частично
+    template <typename ExecutionPolicy, typename Function>
+    void ForEach(ExecutionPolicy&& policy, Function function) const {
+        std::for_each(policy, shards_.begin(), shards_.end(), [&function](const Shard& shard) {
+            const ShardAccess access(shard);
+            for (size_t i = 0; i < shard.capacity; ++i) {
+                const Slot& slot = shard.slots[i];
+                if (slot.state.load(std::memory_order_acquire) == FULL) {
+                    function(slot.GetKey(), slot.value.load(std::memory_order_relaxed));
+                }
+            }
+        });
+    }
+
+    // Все пары одним массивом без упорядочивания: сегменты сначала подсчитываются,
+    // затем каждый заполняет свой участок результата
+    template <typename ExecutionPolicy>
+    std::vector<std::pair<Key, Value>> ExtractItems(ExecutionPolicy&& policy) const {
+        std::vector<size_t> offsets(shards_.size() + 1, 0);
+        std::transform(policy, shards_.begin(), shards_.end(), offsets.begin() + 1, [](const Shard& shard) {
+            const ShardAccess access(shard);
+            return shard.CountItems();
+        });
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+        std::vector<std::pair<Key, Value>> items(offsets.back());
+        std::vector<size_t> shard_indexes(shards_.size());
+        std::iota(shard_indexes.begin(), shard_indexes.end(), 0);
+        std::for_each(policy, shard_indexes.begin(), shard_indexes.end(), [&](size_t index) {
+            const Shard& shard = shards_[index];
+            const ShardAccess access(shard);
+            size_t position = offsets[index];
+            for (size_t i = 0; i < shard.capacity && position < offsets[index + 1]; ++i) {
+                const Slot& slot = shard.slots[i];
+                if (slot.state.load(std::memory_order_acquire) == FULL) {
+                    items[position++] = { slot.GetKey(), slot.value.load(std::memory_order_relaxed) };
+                }
+            }
+        });
+
+        return items;
+    }
+
+    std::map<Key, Value> BuildOrdinaryMap() const {
+        const auto items = ExtractItems(std::execution::par);
+        return { items.begin(), items.end() };
+    }
+
 private:
-    struct Bucket {
-        std::mutex mutex; 
-        std::map<Key, Value> data;
+    static constexpr size_t DEFAULT_SHARD_COUNT = 64;
+    static constexpr size_t MIN_CAPACITY = 16;
+    // Таблица сегмента увеличивается вдвое при заполнении больше чем на 3/4
+    static constexpr size_t MAX_LOAD_NUMERATOR = 3;
+    static constexpr size_t MAX_LOAD_DENOMINATOR = 4;
+
+    // Состояния ячейки: ключ записывается между захватом ячейки и публикацией FULL
+    static constexpr uint8_t EMPTY = 0;
+    static constexpr uint8_t WRITING = 1;
+    static constexpr uint8_t FULL = 2;
+    static constexpr uint8_t ERASED = 3;
+
+    struct SlotData {
+        std::atomic<uint8_t> state{ EMPTY };
+        std::atomic<Value> value{ Value{} };
+        alignas(Key) unsigned char key[sizeof(Key)];
     };
 
-    std::vector<Bucket> buckets_;
+    // Ячейка не пересекает границу кеш-линии
+    struct alignas(GetSlotAlignment(sizeof(SlotData), alignof(SlotData))) Slot : SlotData {
+        Key& GetKey() {
+            return *std::launder(reinterpret_cast<Key*>(this->key));
+        }
+        const Key& GetKey() const {
+            return *std::launder(reinterpret_cast<const Key*>(this->key));
+        }
+    };
+    // Размер ячейки до 64 байт - делитель кеш-линии, и ячейки массива выровнены по своему размеру
+    static_assert(sizeof(Slot) > 64 || 64 % sizeof(Slot) == 0, "ConcurrentMap slot must not cross a cache line");
 
-public:
-    static_assert(std::is_integral_v<Key>, "ConcurrentMap supports only integer keys"s);
+    struct alignas(64) Shard {
+        // Число начатых операций и флаг увеличения таблицы (см. ShardAccess и Grow)
+        mutable std::atomic<size_t> active{ 0 };
+        std::atomic<bool> resizing{ false };
+        std::unique_ptr<Slot[]> slots;
+        size_t capacity = 0;
+        // Занятые ячейки, включая удаленные
+        std::atomic<size_t> used{ 0 };
+
+        Shard() = default;
+
+        ~Shard() {
+            Clear();
+        }
+
+        void Allocate(size_t new_capacity) {
+            slots = std::make_unique<Slot[]>(new_capacity);
+            capacity = new_capacity;
+            used.store(0, std::memory_order_relaxed);
+        }
+
+        void Clear() {
+            if constexpr (!std::is_trivially_destructible_v<Key>) {
+                for (size_t i = 0; i < capacity; ++i) {
+                    if (slots[i].state.load(std::memory_order_relaxed) != EMPTY) {
+                        slots[i].GetKey().~Key();
+                    }
+                }
+            }
+        }
+
+        size_t CountItems() const {
+            size_t count = 0;
+            for (size_t i = 0; i < capacity; ++i) {
+                count += slots[i].state.load(std::memory_order_relaxed) == FULL ? 1 : 0;
+            }
+            return count;
+        }
+
+        // Ожидание публикации ключа ячейки, захваченной другим потоком
+        static uint8_t WaitPublished(const Slot& slot, uint8_t state) {
+            while (state == WRITING) {
+                std::this_thread::yield();
+                state = slot.state.load(std::memory_order_acquire);
+            }
+            return state;
+        }
+
+        Slot* Find(const Key& key, uint64_t hash) {
+            const size_t mask = capacity - 1;
+            for (size_t probe = 0, index = hash & mask; probe < capacity; ++probe, index = (index + 1) & mask) {
+                Slot& slot = slots[index];
+                const uint8_t state = WaitPublished(slot, slot.state.load(std::memory_order_acquire));
+                if (state == EMPTY) {
+                    return nullptr;
+                }
+                if (state == FULL && slot.GetKey() == key) {
+                    return &slot;
+                }
+            }
+            return nullptr;
+        }
 
-    struct Access {
-        std::lock_guard <std::mutex> guard;
-        Value& ref_to_value;
-        
-        Access(const Key& key, Bucket& bucket) : guard(bucket.mutex), ref_to_value(bucket.data[key]) {}
+        // Ячейка ключа; nullptr, если ключа нет, а таблица заполнена - ее нужно увеличить
+        Slot* FindOrInsert(const Key& key, uint64_t hash) {
+            const size_t mask = capacity - 1;
+            for (size_t probe = 0, index = hash & mask; probe < capacity; ++probe, index = (index + 1) & mask) {
+                Slot& slot = slots[index];
+                uint8_t state = slot.state.load(std::memory_order_acquire);
+                if (state == EMPTY) {
+                    if (used.load(std::memory_order_relaxed) * MAX_LOAD_DENOMINATOR
+                        >= capacity * MAX_LOAD_NUMERATOR) {
+                        return nullptr;
+                    }
+                    if (slot.state.compare_exchange_strong(state, WRITING, std::memory_order_acquire)) {
+                        new (slot.key) Key(key);
+                        used.fetch_add(1, std::memory_order_relaxed);
+                        slot.state.store(FULL, std::memory_order_release);
+                        return &slot;
+                    }
+                    // Ячейку захватил другой поток - возможно, с тем же ключом
+                }
+                state = WaitPublished(slot, state);
+                if (state == FULL && slot.GetKey() == key) {
+                    return &slot;
+                }
+            }
+            return nullptr;
+        }
     };
 
-    explicit ConcurrentMap(size_t bucket_count) : buckets_(bucket_count) {}
+    // Отметка операции с сегментом на время ее выполнения. Если таблица увеличивается,
+    // операция снимает отметку и ждет конца увеличения. Обе стороны сначала пишут свой
+    // счетчик или флаг, затем читают чужой (seq_cst): хотя бы одна из них увидит другую
+    class ShardAccess {
+    public:
+        explicit ShardAccess(const Shard& shard) : shard_(shard) {
+            while (true) {
+                shard_.active.fetch_add(1, std::memory_order_seq_cst);
+                if (!shard_.resizing.load(std::memory_order_seq_cst)) {
+                    return;
+                }
+                shard_.active.fetch_sub(1, std::memory_order_release);
+                while (shard_.resizing.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+            }
+        }
 
-    Access operator[](const Key& key) {
-        auto& bucket = buckets_[key % buckets_.size()];
-        
-        return { key, bucket };
-    }
-
-    std::map<Key, Value> BuildOrdinaryMap() {
-        std::map<Key, Value> result;
-        
-        for (auto& [mutex, data] : buckets_) {
-            std::lock_guard guard(mutex);
-            result.insert(data.begin(), data.end());
-        }
-        
-        return result;
-    }
-    
-    void erase(const Key& key) {
-		uint64_t index = static_cast<uint64_t>(key) % buckets_.size(); 
-        
-		std::lock_guard guard(buckets_[index].mutex); 
-        
-		buckets_[index].data.erase(key); 
-	}
-};
\ No newline at end of file
+        ShardAccess(const ShardAccess&) = delete;
+        ShardAccess& operator=(const ShardAccess&) = delete;
+
+        ~ShardAccess() {
+            shard_.active.fetch_sub(1, std::memory_order_release);
+        }
+
+    private:
+        const Shard& shard_;
+    };
+
+    std::vector<Shard> shards_;
+    size_t shard_bits_ = 0;
+    Hash hasher_;
+
+    // Перемешивание битов хеша (финализатор MurmurHash3): std::hash для целых - тождественная функция
+    static uint64_t MixHash(uint64_t hash) {
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb93fe53a4d87ULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    // Увеличение таблицы сегмента, если ее еще не увеличил другой поток.
+    // Вызывается без отметки ShardAccess
+    void Grow(Shard& shard, size_t seen_capacity) {
+        bool resizing = false;
+        if (!shard.resizing.compare_exchange_strong(resizing, true, std::memory_order_seq_cst)) {
+            // Таблицу уже увеличивает другой поток: операция повторится после него
+            while (shard.resizing.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            return;
+        }
+        while (shard.active.load(std::memory_order_seq_cst) != 0) {
+            std::this_thread::yield();
+        }
+        if (shard.capacity != seen_capacity) {
+            shard.resizing.store(false, std::memory_order_release);
+            return;
+        }
+
+        std::unique_ptr<Slot[]> old_slots = std::move(shard.slots);
+        const size_t old_capacity = shard.capacity;
+        shard.Allocate(old_capacity * 2);
+        const size_t mask = shard.capacity - 1;
+        size_t used = 0;
+        for (size_t i = 0; i < old_capacity; ++i) {
+            Slot& old_slot = old_slots[i];
+            const uint8_t state = old_slot.state.load(std::memory_order_relaxed);
+            if (state == FULL) {
+                size_t index = (MixHash(hasher_(old_slot.GetKey())) >> shard_bits_) & mask;
+                while (shard.slots[index].state.load(std::memory_order_relaxed) != EMPTY) {
+                    index = (index + 1) & mask;
+                }
+                Slot& slot = shard.slots[index];
+                new (slot.key) Key(std::move(old_slot.GetKey()));
+                slot.value.store(old_slot.value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                slot.state.store(FULL, std::memory_order_relaxed);
+                ++used;
+            }
+            if (state != EMPTY) {
+                old_slot.GetKey().~Key();
+            }
+        }
+        shard.used.store(used, std::memory_order_relaxed);
+        shard.resizing.store(false, std::memory_order_release);
+    }
+};
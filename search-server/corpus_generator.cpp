@@ -0,0 +1,152 @@
+#include "corpus_generator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+
+std::string GenerateWord(std::mt19937& generator, int max_length) {
+    const int length = std::uniform_int_distribution(1, max_length)(generator);
+    std::string word;
+    word.reserve(length);
+    for (int i = 0; i < length; ++i) {
+        word.push_back(std::uniform_int_distribution('a', 'z')(generator));
+    }
+    return word;
+}
+
+std::vector<std::string> GenerateDictionary(std::mt19937& generator, int word_count, int max_length) {
+    std::vector<std::string> words;
+    words.reserve(word_count);
+    for (int i = 0; i < word_count; ++i) {
+        words.push_back(GenerateWord(generator, max_length));
+    }
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+    return words;
+}
+
+std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string>& dictionary,
+                          int word_count, double minus_prob) {
+    std::string query;
+    for (int i = 0; i < word_count; ++i) {
+        if (!query.empty()) {
+            query.push_back(' ');
+        }
+        if (std::uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
+            query.push_back('-');
+        }
+        query += dictionary[std::uniform_int_distribution<int>(0, dictionary.size() - 1)(generator)];
+    }
+    return query;
+}
+
+std::vector<std::string> GenerateQueries(std::mt19937& generator, const std::vector<std::string>& dictionary,
+                                         int query_count, int max_word_count) {
+    std::vector<std::string> queries;
+    queries.reserve(query_count);
+    for (int i = 0; i < query_count; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, max_word_count));
+    }
+    return queries;
+}
+
+/*
+Реализация ZipfDistribution
+*/
+
+ZipfDistribution::ZipfDistribution(size_t n, double exponent) : cdf_(std::max<size_t>(1, n)) {
+    double sum = 0.0;
+    for (size_t k = 0; k < cdf_.size(); ++k) {
+        sum += 1.0 / std::pow(k + 1.0, exponent);
+        cdf_[k] = sum;
+    }
+    for (double& value : cdf_) {
+        value /= sum;
+    }
+}
+
+size_t ZipfDistribution::operator()(std::mt19937_64& generator) const {
+    const double value = std::uniform_real_distribution<>(0.0, 1.0)(generator);
+    const auto it = std::upper_bound(cdf_.begin(), cdf_.end(), value);
+    return std::min<size_t>(it - cdf_.begin(), cdf_.size() - 1);
+}
+
+/*
+Реализация ZipfCorpusGenerator
+*/
+
+ZipfCorpusGenerator::ZipfCorpusGenerator(const CorpusConfig& config)
+    : ZipfCorpusGenerator(config, config.seed) {
+}
+
+ZipfCorpusGenerator::ZipfCorpusGenerator(const CorpusConfig& config, uint64_t stream_seed)
+    : config_(config)
+    , generator_(stream_seed)
+    , document_words_(config.vocabulary_size, config.document_zipf_exponent)
+    , query_words_(config.vocabulary_size, config.query_zipf_exponent) {
+    // Словарь из уникальных слов; ранг слова - его позиция в словаре
+    std::mt19937 word_generator(static_cast<std::mt19937::result_type>(config.seed));
+    std::unordered_set<std::string> unique_words;
+    vocabulary_.reserve(config.vocabulary_size);
+    while (vocabulary_.size() < config.vocabulary_size) {
+        std::string word = GenerateWord(word_generator, config.max_word_length);
+        if (unique_words.insert(word).second) {
+            vocabulary_.push_back(std::move(word));
+        }
+    }
+}
+
+std::string ZipfCorpusGenerator::GenerateDocument() {
+    const int word_count = std::uniform_int_distribution(
+        config_.min_document_words, config_.max_document_words)(generator_);
+    std::string document;
+    for (int i = 0; i < word_count; ++i) {
+        if (!document.empty()) {
+            document.push_back(' ');
+        }
+        document += vocabulary_[document_words_(generator_)];
+    }
+    return document;
+}
+
+std::vector<std::string> ZipfCorpusGenerator::GenerateDocuments(size_t count) {
+    std::vector<std::string> documents;
+    documents.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        documents.push_back(GenerateDocument());
+    }
+    return documents;
+}
+
+std::string ZipfCorpusGenerator::GenerateQuery() {
+    const int word_count = std::uniform_int_distribution(1, config_.max_query_words)(generator_);
+    std::string query;
+    for (int i = 0; i < word_count; ++i) {
+        if (!query.empty()) {
+            query.push_back(' ');
+        }
+        // Первое слово всегда плюс-слово, иначе запрос может состоять из одних исключений
+        if (i > 0 && std::uniform_real_distribution<>(0, 1)(generator_) < config_.minus_word_prob) {
+            query.push_back('-');
+        }
+        query += vocabulary_[query_words_(generator_)];
+    }
+    return query;
+}
+
+std::vector<std::string> ZipfCorpusGenerator::GenerateQueries(size_t count) {
+    std::vector<std::string> queries;
+    queries.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        queries.push_back(GenerateQuery());
+    }
+    return queries;
+}
+
+std::vector<int> ZipfCorpusGenerator::GenerateRatings() {
+    const int count = std::uniform_int_distribution(1, 3)(generator_);
+    std::vector<int> ratings(count);
+    for (int& rating : ratings) {
+        rating = std::uniform_int_distribution(-10, 10)(generator_);
+    }
+    return ratings;
+}
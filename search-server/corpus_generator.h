@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+std::string GenerateWord(std::mt19937& generator, int max_length);
+
+std::vector<std::string> GenerateDictionary(std::mt19937& generator, int word_count, int max_length);
+
+std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string>& dictionary,
+                          int word_count, double minus_prob = 0);
+
+std::vector<std::string> GenerateQueries(std::mt19937& generator, const std::vector<std::string>& dictionary,
+                                         int query_count, int max_word_count);
+
+/*
+Распределение Ципфа на рангах [0, n): вероятность ранга k пропорциональна 1 / (k + 1)^exponent.
+Выборка - двоичный поиск по предвычисленной функции распределения
+*/
+
+class ZipfDistribution {
+public:
+    ZipfDistribution(size_t n, double exponent);
+
+    size_t operator()(std::mt19937_64& generator) const;
+
+private:
+    std::vector<double> cdf_;
+};
+
+// Параметры синтетического корпуса
+struct CorpusConfig {
+    uint64_t seed = 42;
+    size_t document_count = 10'000;
+    size_t vocabulary_size = 50'000;
+    int max_word_length = 10;
+    // Количество слов в документе выбирается равномерно из [min, max]
+    int min_document_words = 10;
+    int max_document_words = 50;
+    double document_zipf_exponent = 1.0;
+    // Запросы обычно состоят из более редких слов, поэтому распределение площе
+    double query_zipf_exponent = 0.8;
+    int max_query_words = 5;
+    double minus_word_prob = 0.1;
+};
+
+/*
+Воспроизводимый корпус: при одинаковом seed генерируются одни и те же словарь, документы и запросы
+*/
+
+class ZipfCorpusGenerator {
+public:
+    explicit ZipfCorpusGenerator(const CorpusConfig& config);
+
+    // Словарь строится по config.seed, а документы и запросы - по stream_seed:
+    // так несколько генераторов дают разные документы над общим словарем
+    ZipfCorpusGenerator(const CorpusConfig& config, uint64_t stream_seed);
+
+    const std::vector<std::string>& GetVocabulary() const {
+        return vocabulary_;
+    }
+
+    std::string GenerateDocument();
+
+    std::vector<std::string> GenerateDocuments(size_t count);
+
+    std::string GenerateQuery();
+
+    std::vector<std::string> GenerateQueries(size_t count);
+
+    // Рейтинги документа: от одного до трех значений в диапазоне [-10, 10]
+    std::vector<int> GenerateRatings();
+
+private:
+    CorpusConfig config_;
+    std::mt19937_64 generator_;
+    std::vector<std::string> vocabulary_;
+    ZipfDistribution document_words_;
+    ZipfDistribution query_words_;
+};
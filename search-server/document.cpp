@@ -3,4 +3,8 @@
 Document::Document() = default;
 
 Document::Document(int id, double relevance, int rating)
-    : id(id), relevance(relevance), rating(rating) {}
\ No newline at end of file
+    : id(id), relevance(relevance), rating(rating) {}
+
+bool DocumentFilter::operator()(int /*document_id*/, DocumentStatus doc_status, int rating) const {
+    return doc_status == status && AcceptsRating(rating);
+}
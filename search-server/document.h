@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
+#include <limits>
+
 struct Document {
     Document();
     Document(int id, double relevance, int rating);
@@ -9,4 +12,27 @@ struct Document {
     int rating = 0;
 };
 
-enum class DocumentStatus { ACTUAL, IRRELEVANT, BANNED, REMOVED };
\ No newline at end of file
+enum class DocumentStatus { ACTUAL, IRRELEVANT, BANNED, REMOVED };
+
+constexpr size_t DOCUMENT_STATUS_COUNT = 4;
+static_assert(static_cast<size_t>(DocumentStatus::REMOVED) + 1 == DOCUMENT_STATUS_COUNT,
+              "DOCUMENT_STATUS_COUNT must match DocumentStatus");
+
+/*
+Фильтр по статусу и диапазону рейтинга.
+В отличие от произвольного предиката, SearchServer проверяет его прямо при обходе индекса
+по битовой карте статуса и колонке рейтингов
+*/
+
+struct DocumentFilter {
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    int min_rating = std::numeric_limits<int>::min();
+    int max_rating = std::numeric_limits<int>::max();
+    
+    bool AcceptsRating(int rating) const {
+        return min_rating <= rating && rating <= max_rating;
+    }
+    
+    // Совместимость с интерфейсом предиката (document_id, status, rating)
+    bool operator()(int document_id, DocumentStatus doc_status, int rating) const;
+};
@@ -0,0 +1,41 @@
+#include "histogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+uint64_t LogBucketLowerBound(int index) {
+    if (index < LOG_SUB_BUCKET_COUNT) {
+        return static_cast<uint64_t>(index);
+    }
+    const int shift = index / LOG_SUB_BUCKET_COUNT - 1;
+    return static_cast<uint64_t>(LOG_SUB_BUCKET_COUNT + index % LOG_SUB_BUCKET_COUNT) << shift;
+}
+
+uint64_t LogBucketUpperBound(int index) {
+    if (index + 1 >= LOG_BUCKET_COUNT) {
+        return std::numeric_limits<uint64_t>::max();
+    }
+    return LogBucketLowerBound(index + 1) - 1;
+}
+
+uint64_t LogHistogramPercentile(const LogHistogramSnapshot& counts, double percentile) {
+    const uint64_t total = std::accumulate(counts.begin(), counts.end(), uint64_t{0});
+    if (total == 0) {
+        return 0;
+    }
+
+    // Порядковый номер значения, соответствующего перцентилю (нумерация с единицы)
+    percentile = std::clamp(percentile, 0.0, 1.0);
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(percentile * total)));
+
+    uint64_t seen = 0;
+    for (int i = 0; i < LOG_BUCKET_COUNT; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return LogBucketUpperBound(i);
+        }
+    }
+    return LogBucketUpperBound(LOG_BUCKET_COUNT - 1);
+}
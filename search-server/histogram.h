@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/*
+Логарифмическая шкала корзин (в духе HDR-гистограмм):
+каждая степень двойки делится на LOG_SUB_BUCKET_COUNT равных частей,
+поэтому относительная погрешность значения не превышает 1 / LOG_SUB_BUCKET_COUNT (~3%).
+Значения от 2^LOG_VALUE_BITS (для наносекунд - около 18 минут) попадают в последнюю корзину
+*/
+
+constexpr int LOG_SUB_BUCKET_BITS = 5;
+constexpr int LOG_SUB_BUCKET_COUNT = 1 << LOG_SUB_BUCKET_BITS;
+constexpr int LOG_VALUE_BITS = 40;
+constexpr uint64_t LOG_MAX_VALUE = (uint64_t{1} << LOG_VALUE_BITS) - 1;
+constexpr int LOG_BUCKET_COUNT = (LOG_VALUE_BITS - LOG_SUB_BUCKET_BITS + 1) * LOG_SUB_BUCKET_COUNT;
+
+using LogHistogramSnapshot = std::array<uint64_t, LOG_BUCKET_COUNT>;
+
+constexpr int LogBucketIndex(uint64_t value) {
+    if (value < LOG_SUB_BUCKET_COUNT) {
+        return static_cast<int>(value);
+    }
+    value = value < LOG_MAX_VALUE ? value : LOG_MAX_VALUE;
+    // Номер старшего бита определяет октаву, следующие за ним биты - часть октавы
+    const int shift = 63 - __builtin_clzll(value) - LOG_SUB_BUCKET_BITS;
+    return (shift + 1) * LOG_SUB_BUCKET_COUNT + static_cast<int>((value >> shift) - LOG_SUB_BUCKET_COUNT);
+}
+
+// Наименьшее значение, попадающее в корзину
+uint64_t LogBucketLowerBound(int index);
+
+// Наибольшее значение, попадающее в корзину
+uint64_t LogBucketUpperBound(int index);
+
+// Оценка перцентиля (percentile в диапазоне [0, 1]) по верхней границе корзины
+uint64_t LogHistogramPercentile(const LogHistogramSnapshot& counts, double percentile);
+
+/*
+Гистограмма с атомарными счетчиками, допускающая запись из нескольких потоков без блокировок
+*/
+
+template <typename Counter = uint64_t>
+class AtomicLogHistogram {
+public:
+    void Add(uint64_t value, Counter count = 1) {
+        counts_[LogBucketIndex(value)].fetch_add(count, std::memory_order_relaxed);
+    }
+
+    void Reset() {
+        for (auto& count : counts_) {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Прибавляет содержимое гистограммы к снимку
+    void MergeInto(LogHistogramSnapshot& snapshot) const {
+        for (int i = 0; i < LOG_BUCKET_COUNT; ++i) {
+            snapshot[i] += counts_[i].load(std::memory_order_relaxed);
+        }
+    }
+
+private:
+    std::array<std::atomic<Counter>, LOG_BUCKET_COUNT> counts_{};
+};
+
+/*
+Загрубленная гистограмма: корзина объединяет LOG_COARSE_FACTOR соседних корзин шкалы
+(4 части на октаву вместо 32), значения больше MaxValue попадают в последнюю корзину.
+Занимает в десятки раз меньше памяти, поэтому подходит для множества коротких интервалов,
+которые сводятся в снимок полной шкалы только при чтении
+*/
+
+constexpr int LOG_COARSE_FACTOR = 8;
+
+template <typename Counter, uint64_t MaxValue>
+class AtomicCoarseLogHistogram {
+public:
+    static constexpr int BUCKET_COUNT = LogBucketIndex(MaxValue) / LOG_COARSE_FACTOR + 1;
+
+    void Add(uint64_t value, Counter count = 1) {
+        counts_[LogBucketIndex(std::min(value, MaxValue)) / LOG_COARSE_FACTOR].fetch_add(count, std::memory_order_relaxed);
+    }
+
+    void Reset() {
+        for (auto& count : counts_) {
+            count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Прибавляет содержимое к снимку полной шкалы. Счетчик попадает в старшую из объединенных
+    // корзин, так что перцентили, как и для полной шкалы, оцениваются сверху
+    void MergeInto(LogHistogramSnapshot& snapshot) const {
+        for (int i = 0; i < BUCKET_COUNT; ++i) {
+            snapshot[(i + 1) * LOG_COARSE_FACTOR - 1] += counts_[i].load(std::memory_order_relaxed);
+        }
+    }
+
+private:
+    std::array<std::atomic<Counter>, BUCKET_COUNT> counts_{};
+};
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "memory_usage.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// Шкала квантования TF: вклад хранится как ceil(TF * IMPACT_LEVELS) в одном байте
+constexpr double IMPACT_LEVELS = 255.0;
+
+inline uint8_t QuantizeImpact(double term_freq) {
+    const double level = std::ceil(term_freq * IMPACT_LEVELS);
+    return static_cast<uint8_t>(std::clamp(level, 1.0, IMPACT_LEVELS));
+}
+
+/*
+Список вхождений слова, упорядоченный по убыванию вклада (impact) и по возрастанию
+порядковых номеров внутри одного уровня. Хранит квантованный TF и закешированный IDF слова:
+вклад документа лежит в пределах [(impact - 1), impact] * IDF / IMPACT_LEVELS.
+Добавления и удаления копятся в несортированных буферах и вливаются в упорядоченный массив
+одним слиянием (Flush), поэтому загрузка документов не сдвигает массив на каждой вставке.
+Методы чтения по позиции (GetOrdinal, GetImpact, GetLevelEnd) требуют пустых буферов
+*/
+
+class ImpactList {
+public:
+    void Insert(int ordinal, uint8_t impact) {
+        pending_inserts_.push_back({ impact, ordinal });
+    }
+
+    // Удаляемое вхождение должно быть в списке (в том числе среди еще не влитых)
+    void Erase(int ordinal, uint8_t impact) {
+        pending_erases_.push_back({ impact, ordinal });
+    }
+
+    bool HasPendingChanges() const {
+        return !pending_inserts_.empty() || !pending_erases_.empty();
+    }
+
+    // Слияние буферов с упорядоченным массивом: O(n + k log k) для k накопленных изменений
+    void Flush() {
+        if (!HasPendingChanges()) {
+            return;
+        }
+        std::sort(pending_inserts_.begin(), pending_inserts_.end(), ComparePostings);
+        std::sort(pending_erases_.begin(), pending_erases_.end(), ComparePostings);
+
+        std::vector<int> ordinals;
+        std::vector<uint8_t> impacts;
+        ordinals.reserve(Size());
+        impacts.reserve(Size());
+        size_t erased = 0;
+        auto append = [&](const Posting& posting) {
+            while (erased < pending_erases_.size() && ComparePostings(pending_erases_[erased], posting)) {
+                ++erased;
+            }
+            if (erased < pending_erases_.size() && pending_erases_[erased] == posting) {
+                ++erased;
+                return;
+            }
+            impacts.push_back(posting.first);
+            ordinals.push_back(posting.second);
+        };
+
+        size_t inserted = 0;
+        for (size_t i = 0; i < ordinals_.size(); ++i) {
+            const Posting posting{ impacts_[i], ordinals_[i] };
+            for (; inserted < pending_inserts_.size() && ComparePostings(pending_inserts_[inserted], posting);
+                 ++inserted) {
+                append(pending_inserts_[inserted]);
+            }
+            append(posting);
+        }
+        for (; inserted < pending_inserts_.size(); ++inserted) {
+            append(pending_inserts_[inserted]);
+        }
+
+        ordinals_ = std::move(ordinals);
+        impacts_ = std::move(impacts);
+        std::vector<Posting>().swap(pending_inserts_);
+        std::vector<Posting>().swap(pending_erases_);
+    }
+
+    // Перенумерация документов с сохранением их порядка, как в PostingList::Renumber
+    void Renumber(const std::vector<int>& new_ordinals) {
+        Flush();
+        size_t size = 0;
+        for (size_t i = 0; i < ordinals_.size(); ++i) {
+            const int ordinal = new_ordinals[ordinals_[i]];
+            if (ordinal >= 0) {
+                ordinals_[size] = ordinal;
+                impacts_[size] = impacts_[i];
+                ++size;
+            }
+        }
+        ordinals_.resize(size);
+        impacts_.resize(size);
+    }
+
+    // Число документов с учетом еще не влитых изменений
+    size_t Size() const {
+        return ordinals_.size() + pending_inserts_.size() - pending_erases_.size();
+    }
+
+    bool Empty() const {
+        return Size() == 0;
+    }
+
+    int GetOrdinal(size_t position) const {
+        return ordinals_[position];
+    }
+
+    uint8_t GetImpact(size_t position) const {
+        return impacts_[position];
+    }
+
+    // Конец серии вхождений с тем же вкладом, что и в позиции begin
+    size_t GetLevelEnd(size_t begin) const {
+        return FindLevel(impacts_[begin]).second;
+    }
+
+    double GetIdf() const {
+        return idf_;
+    }
+
+    void RefreshIdf(size_t document_count) {
+        const size_t size = Size();
+        idf_ = size == 0 ? 0.0 : std::log(document_count * 1.0 / size);
+    }
+
+    MemoryUsage GetMemoryUsage() const {
+        MemoryUsage usage = GetVectorMemoryUsage(ordinals_);
+        usage += GetVectorMemoryUsage(impacts_);
+        usage += GetVectorMemoryUsage(pending_inserts_);
+        usage += GetVectorMemoryUsage(pending_erases_);
+        usage.objects = Size();
+        return usage;
+    }
+
+private:
+    // Вхождение в буфере изменений: (вклад, порядковый номер)
+    using Posting = std::pair<uint8_t, int>;
+
+    std::vector<int> ordinals_;
+    std::vector<uint8_t> impacts_;
+    std::vector<Posting> pending_inserts_;
+    std::vector<Posting> pending_erases_;
+    double idf_ = 0.0;
+
+    // Порядок списка: по убыванию вклада, внутри уровня - по возрастанию номера
+    static bool ComparePostings(const Posting& lhs, const Posting& rhs) {
+        return lhs.first != rhs.first ? lhs.first > rhs.first : lhs.second < rhs.second;
+    }
+
+    std::pair<size_t, size_t> FindLevel(uint8_t impact) const {
+        const auto begin = std::lower_bound(impacts_.begin(), impacts_.end(), impact, std::greater<>());
+        const auto end = std::upper_bound(begin, impacts_.end(), impact, std::greater<>());
+        return { begin - impacts_.begin(), end - impacts_.begin() };
+    }
+};
@@ -0,0 +1,409 @@
+#include "load_generator.h"
+
+#include "histogram.h"
+#include "process_queries.h"
+#include "search_server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <execution>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+using std::literals::string_literals::operator""s;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Запрос с запланированным моментом отправки
+struct Job {
+    size_t query_index;
+    Clock::time_point intended_start;
+};
+
+class JobQueue {
+public:
+    void Push(const Job& job) {
+        {
+            std::lock_guard guard(mutex_);
+            jobs_.push_back(job);
+        }
+        ready_.notify_one();
+    }
+
+    // Пустой результат - очередь закрыта и все задания разобраны
+    std::optional<Job> Pop() {
+        std::unique_lock lock(mutex_);
+        ready_.wait(lock, [this] { return closed_ || !jobs_.empty(); });
+        if (jobs_.empty()) {
+            return std::nullopt;
+        }
+        const Job job = jobs_.front();
+        jobs_.pop_front();
+        return job;
+    }
+
+    void Close() {
+        {
+            std::lock_guard guard(mutex_);
+            closed_ = true;
+        }
+        ready_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<Job> jobs_;
+    bool closed_ = false;
+};
+
+uint64_t ToNs(Clock::duration duration) {
+    return std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+}
+
+// Перцентиль гистограммы наносекунд в микросекундах
+double PercentileUs(const AtomicLogHistogram<uint64_t>& histogram, double percentile) {
+    LogHistogramSnapshot counts{};
+    histogram.MergeInto(counts);
+    return LogHistogramPercentile(counts, percentile) * 1e-3;
+}
+
+/*
+Состояние нагрузочного прогона, общее для всех шагов
+*/
+
+class LoadRunner {
+public:
+    LoadRunner(const LoadConfig& config, std::ostream& log)
+        : config_(config)
+        , generator_(config.corpus) {
+        const auto& vocabulary = generator_.GetVocabulary();
+        const std::vector<std::string> stop_words(vocabulary.begin(),
+                                                  vocabulary.begin() + std::min<size_t>(10, vocabulary.size()));
+        search_server_ = std::make_unique<SearchServer>(stop_words);
+
+        log << "Indexing "s << config.corpus.document_count << " documents"s << std::endl;
+        for (size_t i = 0; i < config.corpus.document_count; ++i) {
+            search_server_->AddDocument(next_document_id_++, generator_.GenerateDocument(),
+                                        DocumentStatus::ACTUAL, generator_.GenerateRatings());
+        }
+
+        if (config.query_log_path.empty()) {
+            queries_ = generator_.GenerateQueries(100'000);
+        } else {
+            std::ifstream in(config.query_log_path);
+            if (!in) {
+                throw std::invalid_argument("Cannot open query log "s + config.query_log_path);
+            }
+            for (std::string line; std::getline(in, line);) {
+                if (!line.empty()) {
+                    queries_.push_back(std::move(line));
+                }
+            }
+            if (queries_.empty()) {
+                throw std::invalid_argument("Query log is empty"s);
+            }
+        }
+
+        // Пакеты для ProcessQueries нарезаются из того же потока запросов
+        if (config.target == LoadTarget::PROCESS_QUERIES) {
+            const size_t batch_size = std::max<size_t>(1, config.batch_size);
+            for (size_t begin = 0; begin < queries_.size(); begin += batch_size) {
+                const size_t end = std::min(queries_.size(), begin + batch_size);
+                batches_.emplace_back(queries_.begin() + begin, queries_.begin() + end);
+            }
+        }
+    }
+
+    LoadStepResult RunStep(double rate, Clock::duration duration) {
+        LoadStepResult result;
+        result.offered_rate = rate;
+        if (rate <= 0) {
+            return result;
+        }
+
+        // Значения в наносекундах, перцентили - в микросекундах.
+        // Гистограммы собственные, а не из реестра метрик: замеры нужны и в сборке без метрик
+        AtomicLogHistogram<uint64_t> latency;
+        AtomicLogHistogram<uint64_t> service;
+        AtomicLogHistogram<uint64_t> ingest;
+        std::atomic<uint64_t> completed{ 0 };
+        std::atomic<uint64_t> errors{ 0 };
+        std::atomic<uint64_t> ingested{ 0 };
+        std::atomic<int64_t> last_completion_ns{ 0 };
+        JobQueue queue;
+
+        const auto start = Clock::now() + std::chrono::milliseconds(1);
+        const auto stop = start + duration;
+
+        const size_t worker_count = config_.worker_count > 0
+            ? config_.worker_count : std::max(1u, std::thread::hardware_concurrency());
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < worker_count; ++i) {
+            workers.emplace_back([&] {
+                while (const auto job = queue.Pop()) {
+                    const auto service_start = Clock::now();
+                    if (!Execute(job->query_index)) {
+                        errors.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    const auto finish = Clock::now();
+
+                    latency.Add(ToNs(finish - job->intended_start));
+                    service.Add(ToNs(finish - service_start));
+                    completed.fetch_add(1, std::memory_order_relaxed);
+
+                    const int64_t finish_ns = ToNs(finish - start);
+                    int64_t last = last_completion_ns.load(std::memory_order_relaxed);
+                    while (last < finish_ns
+                           && !last_completion_ns.compare_exchange_weak(last, finish_ns, std::memory_order_relaxed)) {
+                    }
+                }
+            });
+        }
+
+        // Запись идет по собственному расписанию и конкурирует с запросами за индекс
+        std::thread ingest_thread;
+        if (config_.ingest_rate > 0) {
+            ingest_thread = std::thread([&] {
+                const auto interval = std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(1.0 / config_.ingest_rate));
+                for (auto intended = start; intended < stop; intended += interval) {
+                    std::this_thread::sleep_until(intended);
+                    const std::string document = ingest_generator_.GenerateDocument();
+                    const std::vector<int> ratings = ingest_generator_.GenerateRatings();
+                    {
+                        std::unique_lock lock(server_mutex_);
+                        search_server_->AddDocument(next_document_id_++, document, DocumentStatus::ACTUAL, ratings);
+                    }
+                    ingest.Add(ToNs(Clock::now() - intended));
+                    ingested.fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+        }
+
+        // Открытый цикл: запросы отправляются по расписанию независимо от того, завершились ли предыдущие
+        std::mt19937_64 random(config_.corpus.seed + step_++);
+        std::exponential_distribution<double> poisson_interval(rate);
+        const size_t job_count = config_.target == LoadTarget::PROCESS_QUERIES ? batches_.size() : queries_.size();
+        auto intended = start;
+        while (intended < stop) {
+            std::this_thread::sleep_until(intended);
+            queue.Push({ (query_cursor_++) % job_count, intended });
+
+            const double interval_seconds = config_.arrival == ArrivalProcess::POISSON
+                ? poisson_interval(random) : 1.0 / rate;
+            intended += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(interval_seconds));
+        }
+
+        queue.Close();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        if (ingest_thread.joinable()) {
+            ingest_thread.join();
+        }
+
+        result.completed = completed;
+        result.errors = errors;
+        const double elapsed_seconds = std::max(
+            std::chrono::duration<double>(duration).count(), last_completion_ns.load() * 1e-9);
+        result.achieved_rate = result.completed / elapsed_seconds;
+        result.latency_p50_us = PercentileUs(latency, 0.5);
+        result.latency_p99_us = PercentileUs(latency, 0.99);
+        result.latency_p999_us = PercentileUs(latency, 0.999);
+        result.latency_max_us = PercentileUs(latency, 1.0);
+        result.service_p50_us = PercentileUs(service, 0.5);
+        result.service_p99_us = PercentileUs(service, 0.99);
+        result.documents_ingested = ingested;
+        result.ingest_p99_us = PercentileUs(ingest, 0.99);
+
+        return result;
+    }
+
+private:
+    const LoadConfig& config_;
+    ZipfCorpusGenerator generator_;
+    // Отдельный генератор для фоновой записи, чтобы не делить состояние с основным потоком.
+    // Словарь у него тот же, что у запросов, различается только поток документов
+    ZipfCorpusGenerator ingest_generator_{ config_.corpus, config_.corpus.seed + 1 };
+    std::unique_ptr<SearchServer> search_server_;
+    // SearchServer не допускает записи одновременно с чтением
+    std::shared_mutex server_mutex_;
+    int next_document_id_ = 0;
+    std::vector<std::string> queries_;
+    std::vector<std::vector<std::string>> batches_;
+    size_t query_cursor_ = 0;
+    uint64_t step_ = 0;
+
+    // false - запрос отклонен с исключением; такой запрос считается ошибкой, прогон продолжается
+    bool Execute(size_t index) {
+        std::shared_lock lock(server_mutex_);
+        try {
+            switch (config_.target) {
+            case LoadTarget::FIND_TOP_SEQ:
+                search_server_->FindTopDocuments(std::execution::seq, queries_[index]);
+                break;
+            case LoadTarget::FIND_TOP_PAR:
+                search_server_->FindTopDocuments(std::execution::par, queries_[index]);
+                break;
+            case LoadTarget::PROCESS_QUERIES:
+                ProcessQueries(*search_server_, batches_[index]);
+                break;
+            }
+        } catch (const std::exception&) {
+            return false;
+        }
+        return true;
+    }
+};
+
+template <typename Number>
+std::vector<Number> ParseList(const std::string& text) {
+    std::vector<Number> values;
+    std::istringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        values.push_back(static_cast<Number>(std::stod(item)));
+    }
+    return values;
+}
+
+} // namespace
+
+std::vector<LoadStepResult> RunLoad(const LoadConfig& config, std::ostream& log) {
+    LoadRunner runner(config, log);
+
+    if (config.warmup.count() > 0 && !config.rates.empty()) {
+        log << "Warming up at "s << config.rates.front() << " req/s"s << std::endl;
+        runner.RunStep(config.rates.front(), config.warmup);
+    }
+
+    std::vector<LoadStepResult> results;
+    for (const double rate : config.rates) {
+        log << "Offering "s << rate << " req/s"s << std::endl;
+        results.push_back(runner.RunStep(rate, config.step_duration));
+    }
+    return results;
+}
+
+void WriteLoadReport(std::ostream& out, const std::vector<LoadStepResult>& results) {
+    const auto flags = out.flags();
+    out << std::fixed << std::setprecision(1);
+    out << std::setw(10) << "offered"s << std::setw(10) << "achieved"s
+        << std::setw(12) << "p50 us"s << std::setw(12) << "p99 us"s << std::setw(12) << "p999 us"s
+        << std::setw(12) << "max us"s << std::setw(14) << "svc p99 us"s << std::setw(10) << "ingested"s
+        << std::setw(10) << "errors"s << "\n"s;
+    for (const LoadStepResult& result : results) {
+        out << std::setw(10) << result.offered_rate << std::setw(10) << result.achieved_rate
+            << std::setw(12) << result.latency_p50_us << std::setw(12) << result.latency_p99_us
+            << std::setw(12) << result.latency_p999_us << std::setw(12) << result.latency_max_us
+            << std::setw(14) << result.service_p99_us << std::setw(10) << result.documents_ingested
+            << std::setw(10) << result.errors << "\n"s;
+    }
+    out.flags(flags);
+}
+
+void WriteLoadJson(std::ostream& out, const std::vector<LoadStepResult>& results) {
+    const auto precision = out.precision(10);
+    out << "{\"steps\": ["s;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const LoadStepResult& result = results[i];
+        out << (i == 0 ? "\n"s : ",\n"s)
+            << "  {\"offered_rate\": "s << result.offered_rate
+            << ", \"achieved_rate\": "s << result.achieved_rate
+            << ", \"completed\": "s << result.completed
+            << ", \"errors\": "s << result.errors
+            << ", \"latency_p50_us\": "s << result.latency_p50_us
+            << ", \"latency_p99_us\": "s << result.latency_p99_us
+            << ", \"latency_p999_us\": "s << result.latency_p999_us
+            << ", \"latency_max_us\": "s << result.latency_max_us
+            << ", \"service_p50_us\": "s << result.service_p50_us
+            << ", \"service_p99_us\": "s << result.service_p99_us
+            << ", \"documents_ingested\": "s << result.documents_ingested
+            << ", \"ingest_p99_us\": "s << result.ingest_p99_us << "}"s;
+    }
+    out << "\n]}\n"s;
+    out.precision(precision);
+}
+
+int RunLoadTool(const std::vector<std::string>& args) {
+    LoadConfig config;
+    config.corpus.document_count = 100'000;
+    std::string out_path;
+
+    try {
+        for (size_t i = 0; i < args.size(); ++i) {
+            const std::string& key = args[i];
+            if (i + 1 >= args.size()) {
+                throw std::invalid_argument("Missing value for "s + key);
+            }
+            const std::string& value = args[++i];
+            if (key == "--docs"s) {
+                config.corpus.document_count = std::stoull(value);
+            } else if (key == "--rates"s) {
+                config.rates = ParseList<double>(value);
+            } else if (key == "--duration"s) {
+                config.step_duration = std::chrono::milliseconds(static_cast<int64_t>(std::stod(value) * 1000));
+            } else if (key == "--warmup"s) {
+                config.warmup = std::chrono::milliseconds(static_cast<int64_t>(std::stod(value) * 1000));
+            } else if (key == "--arrival"s) {
+                if (value == "poisson"s) {
+                    config.arrival = ArrivalProcess::POISSON;
+                } else if (value == "constant"s) {
+                    config.arrival = ArrivalProcess::CONSTANT;
+                } else {
+                    throw std::invalid_argument("Unknown arrival process "s + value);
+                }
+            } else if (key == "--target"s) {
+                if (value == "seq"s) {
+                    config.target = LoadTarget::FIND_TOP_SEQ;
+                } else if (value == "par"s) {
+                    config.target = LoadTarget::FIND_TOP_PAR;
+                } else if (value == "batch"s) {
+                    config.target = LoadTarget::PROCESS_QUERIES;
+                } else {
+                    throw std::invalid_argument("Unknown target "s + value);
+                }
+            } else if (key == "--batch"s) {
+                config.batch_size = std::stoull(value);
+            } else if (key == "--workers"s) {
+                config.worker_count = std::stoull(value);
+            } else if (key == "--ingest-rate"s) {
+                config.ingest_rate = std::stod(value);
+            } else if (key == "--queries-file"s) {
+                config.query_log_path = value;
+            } else if (key == "--seed"s) {
+                config.corpus.seed = std::stoull(value);
+            } else if (key == "--out"s) {
+                out_path = value;
+            } else {
+                throw std::invalid_argument("Unknown option "s + key);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << "Usage: load [--docs N] [--rates R,R] [--duration SEC] [--warmup SEC]"s
+                  << " [--arrival poisson|constant] [--target seq|par|batch] [--batch N] [--workers N]"s
+                  << " [--ingest-rate N] [--queries-file FILE] [--seed N] [--out FILE]"s << std::endl;
+        return 2;
+    }
+
+    const std::vector<LoadStepResult> results = RunLoad(config, std::cerr);
+    WriteLoadReport(std::cout, results);
+    if (!out_path.empty()) {
+        std::ofstream out(out_path);
+        WriteLoadJson(out, results);
+    }
+    return 0;
+}
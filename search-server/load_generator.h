@@ -0,0 +1,69 @@
+#pragma once
+
+#include "corpus_generator.h"
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Распределение моментов поступления запросов
+enum class ArrivalProcess { CONSTANT, POISSON };
+
+// Способ выполнения запроса
+enum class LoadTarget { FIND_TOP_SEQ, FIND_TOP_PAR, PROCESS_QUERIES };
+
+struct LoadConfig {
+    CorpusConfig corpus;
+    // Журнал запросов (по одному в строке); если не задан, используется поток Ципфа
+    std::string query_log_path;
+    // Предлагаемая нагрузка: запросов (для PROCESS_QUERIES - пакетов) в секунду на каждом шаге
+    std::vector<double> rates = { 1'000, 2'000, 5'000 };
+    std::chrono::milliseconds step_duration{ 10'000 };
+    std::chrono::milliseconds warmup{ 1'000 };
+    ArrivalProcess arrival = ArrivalProcess::POISSON;
+    LoadTarget target = LoadTarget::FIND_TOP_SEQ;
+    size_t batch_size = 16;
+    size_t worker_count = 0; // 0 - по числу аппаратных потоков
+    // Фоновое добавление документов в секунду (0 - без записи)
+    double ingest_rate = 0.0;
+};
+
+/*
+Результат одного шага нагрузки.
+Задержка отсчитывается от запланированного момента отправки запроса, а не от фактического,
+поэтому время ожидания в очереди при перегрузке не теряется (coordinated omission)
+*/
+
+struct LoadStepResult {
+    double offered_rate = 0.0;
+    double achieved_rate = 0.0;
+    uint64_t completed = 0;
+    // Запросы, отклоненные с исключением (например, некорректные строки журнала)
+    uint64_t errors = 0;
+    double latency_p50_us = 0.0;
+    double latency_p99_us = 0.0;
+    double latency_p999_us = 0.0;
+    double latency_max_us = 0.0;
+    // Время собственно обработки, без ожидания в очереди
+    double service_p50_us = 0.0;
+    double service_p99_us = 0.0;
+    uint64_t documents_ingested = 0;
+    double ingest_p99_us = 0.0;
+};
+
+std::vector<LoadStepResult> RunLoad(const LoadConfig& config, std::ostream& log);
+
+void WriteLoadReport(std::ostream& out, const std::vector<LoadStepResult>& results);
+
+void WriteLoadJson(std::ostream& out, const std::vector<LoadStepResult>& results);
+
+/*
+Точка входа командной строки:
+load [--docs N] [--rates 1000,2000] [--duration SEC] [--warmup SEC] [--arrival poisson|constant]
+     [--target seq|par|batch] [--batch N] [--workers N] [--ingest-rate N] [--queries-file FILE]
+     [--seed N] [--out FILE]
+*/
+
+int RunLoadTool(const std::vector<std::string>& args);
@@ -1,54 +1,20 @@
 #include "search_server.h"
 #include "process_queries.h"
 #include "log_duration.h"
+#include "corpus_generator.h"
+#include "benchmark.h"
+#include "load_generator.h"
+#include "batch_processor.h"
+#include "test_example_functions.h"
 #include <execution>
 #include <iostream>
 #include <random>
 #include <string>
 #include <vector>
 using namespace std;
-string GenerateWord(mt19937& generator, int max_length) {
-    const int length = uniform_int_distribution(1, max_length)(generator);
-    string word;
-    word.reserve(length);
-    for (int i = 0; i < length; ++i) {
-        word.push_back(uniform_int_distribution('a', 'z')(generator));
-    }
-    return word;
-}
-vector<string> GenerateDictionary(mt19937& generator, int word_count, int max_length) {
-    vector<string> words;
-    words.reserve(word_count);
-    for (int i = 0; i < word_count; ++i) {
-        words.push_back(GenerateWord(generator, max_length));
-    }
-    words.erase(unique(words.begin(), words.end()), words.end());
-    return words;
-}
-string GenerateQuery(mt19937& generator, const vector<string>& dictionary, int word_count, double minus_prob = 0) {
-    string query;
-    for (int i = 0; i < word_count; ++i) {
-        if (!query.empty()) {
-            query.push_back(' ');
-        }
-        if (uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
-            query.push_back('-');
-        }
-        query += dictionary[uniform_int_distribution<int>(0, dictionary.size() - 1)(generator)];
-    }
-    return query;
-}
-vector<string> GenerateQueries(mt19937& generator, const vector<string>& dictionary, int query_count, int max_word_count) {
-    vector<string> queries;
-    queries.reserve(query_count);
-    for (int i = 0; i < query_count; ++i) {
-        queries.push_back(GenerateQuery(generator, dictionary, max_word_count));
-    }
-    return queries;
-}
 template <typename ExecutionPolicy>
 void Test(string_view mark, const SearchServer& search_server, const vector<string>& queries, ExecutionPolicy&& policy) {
-    LOG_DURATION(mark);
+    LOG_DURATION(string{mark});
     double total_relevance = 0;
     for (const string_view query : queries) {
         for (const auto& document : search_server.FindTopDocuments(policy, query)) {
@@ -58,7 +24,24 @@ void Test(string_view mark, const SearchServer& search_server, const vector<stri
     cout << total_relevance << endl;
 }
 #define TEST(policy) Test(#policy, search_server, queries, execution::policy)
-int main() {
+int main(int argc, char* argv[]) {
+    // Набор бенчмарков с выводом в JSON: search-server bench [опции]
+    if (argc > 1 && argv[1] == "bench"s) {
+        return RunBenchmarkTool(vector<string>(argv + 2, argv + argc));
+    }
+    // Нагрузочное тестирование открытым циклом: search-server load [опции]
+    if (argc > 1 && argv[1] == "load"s) {
+        return RunLoadTool(vector<string>(argv + 2, argv + argc));
+    }
+    // Пакетная обработка команд из файла или стандартного ввода: search-server batch [опции]
+    if (argc > 1 && argv[1] == "batch"s) {
+        return RunBatchTool(vector<string>(argv + 2, argv + argc));
+    }
+    // Модульные тесты: search-server test
+    if (argc > 1 && argv[1] == "test"s) {
+        TestSearchServer();
+        return 0;
+    }
     mt19937 generator;
     const auto dictionary = GenerateDictionary(generator, 1000, 10);
     const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+Оценка памяти, занимаемой структурой данных:
+bytes - полезные данные, reserved_bytes - выделенный, но не занятый запас векторов,
+overhead_bytes - служебные поля узлов деревьев и заголовки блоков аллокатора.
+Накладные расходы оцениваются для типичной реализации (libstdc++ и glibc malloc)
+*/
+
+struct MemoryUsage {
+    std::string name;
+    size_t objects = 0;
+    size_t bytes = 0;
+    size_t reserved_bytes = 0;
+    size_t overhead_bytes = 0;
+
+    size_t Total() const {
+        return bytes + reserved_bytes + overhead_bytes;
+    }
+
+    MemoryUsage& operator+=(const MemoryUsage& other) {
+        objects += other.objects;
+        bytes += other.bytes;
+        reserved_bytes += other.reserved_bytes;
+        overhead_bytes += other.overhead_bytes;
+        return *this;
+    }
+};
+
+/*
+Отчет о памяти SearchServer: оценка по каждой структуре и самые большие списки вхождений
+*/
+
+struct MemoryReport {
+    std::vector<MemoryUsage> structures;
+    // Слово и объем его списка вхождений в байтах, по убыванию объема
+    std::vector<std::pair<std::string_view, size_t>> largest_posting_lists;
+
+    size_t TotalBytes() const {
+        size_t total = 0;
+        for (const MemoryUsage& usage : structures) {
+            total += usage.Total();
+        }
+        return total;
+    }
+};
+
+// Заголовок блока, который malloc добавляет к каждому выделению
+constexpr size_t ALLOCATION_OVERHEAD = 2 * sizeof(size_t);
+// Служебные поля узла std::map/std::set: цвет и три указателя
+constexpr size_t TREE_NODE_OVERHEAD = 4 * sizeof(void*);
+
+template <typename T>
+MemoryUsage GetVectorMemoryUsage(const std::vector<T>& values) {
+    MemoryUsage usage;
+    usage.objects = values.size();
+    usage.bytes = values.size() * sizeof(T);
+    usage.reserved_bytes = (values.capacity() - values.size()) * sizeof(T);
+    usage.overhead_bytes = values.capacity() > 0 ? ALLOCATION_OVERHEAD : 0;
+    return usage;
+}
+
+// Прирост памяти вектора при добавлении added элементов: если емкости не хватает,
+// libstdc++ выделяет блок как минимум вдвое больше прежнего
+template <typename T>
+size_t GetVectorGrowthBytes(const std::vector<T>& values, size_t added) {
+    if (values.size() + added <= values.capacity()) {
+        return 0;
+    }
+    return (std::max(2 * values.capacity(), values.size() + added) - values.capacity()) * sizeof(T);
+}
+
+// Узлы дерева без учета памяти, на которую ссылаются сами элементы
+template <typename Tree>
+MemoryUsage GetTreeMemoryUsage(const Tree& tree) {
+    MemoryUsage usage;
+    usage.objects = tree.size();
+    usage.bytes = tree.size() * sizeof(typename Tree::value_type);
+    usage.overhead_bytes = tree.size() * (TREE_NODE_OVERHEAD + ALLOCATION_OVERHEAD);
+    return usage;
+}
+
+// Память строки вне объекта std::string (короткие строки хранятся в самом объекте)
+inline MemoryUsage GetStringHeapUsage(const std::string& text) {
+    static const size_t inline_capacity = std::string().capacity();
+    MemoryUsage usage;
+    if (text.capacity() > inline_capacity) {
+        usage.bytes = text.size() + 1;
+        usage.reserved_bytes = text.capacity() - text.size();
+        usage.overhead_bytes = ALLOCATION_OVERHEAD;
+    }
+    return usage;
+}
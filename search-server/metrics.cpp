@@ -0,0 +1,313 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using std::literals::string_literals::operator""s;
+
+size_t CurrentMetricShard() {
+    static std::atomic<size_t> next_shard{ 0 };
+    thread_local const size_t shard = next_shard.fetch_add(1, std::memory_order_relaxed) % METRIC_SHARD_COUNT;
+    return shard;
+}
+
+/*
+Реализация MetricCounter, MetricGauge, MetricHistogram
+*/
+
+uint64_t MetricCounter::Value() const {
+    uint64_t result = 0;
+    for (const Shard& shard : shards_) {
+        result += shard.value.load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+void MetricGauge::Add([[maybe_unused]] double delta) {
+#ifndef SEARCH_SERVER_NO_METRICS
+    double current = value_.load(std::memory_order_relaxed);
+    while (!value_.compare_exchange_weak(current, current + delta, std::memory_order_relaxed)) {
+    }
+#endif
+}
+
+LogHistogramSnapshot MetricHistogram::Snapshot() const {
+    LogHistogramSnapshot result{};
+    for (const Shard& shard : shards_) {
+        shard.counts.MergeInto(result);
+    }
+    return result;
+}
+
+uint64_t MetricHistogram::Count() const {
+    uint64_t result = 0;
+    for (uint64_t count : Snapshot()) {
+        result += count;
+    }
+    return result;
+}
+
+uint64_t MetricHistogram::Sum() const {
+    uint64_t result = 0;
+    for (const Shard& shard : shards_) {
+        result += shard.sum.load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+double MetricHistogram::Percentile(double percentile) const {
+    return LogHistogramPercentile(Snapshot(), percentile) * export_scale_;
+}
+
+/*
+Реализация MetricsRegistry
+*/
+
+MetricsRegistry& MetricsRegistry::Instance() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+MetricsRegistry::Family& MetricsRegistry::GetFamily(const std::string& name, const std::string& help,
+                                                    MetricType type) {
+    auto [it, inserted] = families_.try_emplace(name);
+    if (inserted) {
+        it->second.type = type;
+        it->second.help = help;
+    } else if (it->second.type != type) {
+        throw std::invalid_argument("Metric "s + name + " is already registered with another type"s);
+    }
+    return it->second;
+}
+
+MetricCounter& MetricsRegistry::GetCounter(const std::string& name, const std::string& help,
+                                           const std::string& labels) {
+    std::lock_guard guard(mutex_);
+    auto& metric = GetFamily(name, help, MetricType::COUNTER).counters[labels];
+    if (!metric) {
+        metric = std::make_unique<MetricCounter>();
+    }
+    return *metric;
+}
+
+MetricGauge& MetricsRegistry::GetGauge(const std::string& name, const std::string& help,
+                                       const std::string& labels) {
+    std::lock_guard guard(mutex_);
+    auto& metric = GetFamily(name, help, MetricType::GAUGE).gauges[labels];
+    if (!metric) {
+        metric = std::make_unique<MetricGauge>();
+    }
+    return *metric;
+}
+
+MetricHistogram& MetricsRegistry::GetHistogram(const std::string& name, const std::string& help,
+                                               const std::string& labels, double export_scale) {
+    std::lock_guard guard(mutex_);
+    auto& metric = GetFamily(name, help, MetricType::HISTOGRAM).histograms[labels];
+    if (!metric) {
+        metric = std::make_unique<MetricHistogram>(export_scale);
+    }
+    return *metric;
+}
+
+namespace {
+
+// Строка меток в фигурных скобках с дополнительной меткой (для le у гистограмм)
+std::string FormatLabels(const std::string& labels, const std::string& extra = {}) {
+    if (labels.empty() && extra.empty()) {
+        return {};
+    }
+    if (labels.empty() || extra.empty()) {
+        return "{"s + labels + extra + "}"s;
+    }
+    return "{"s + labels + ","s + extra + "}"s;
+}
+
+void WriteHistogram(std::ostream& out, const std::string& name, const std::string& labels,
+                    const MetricHistogram& histogram) {
+    const LogHistogramSnapshot counts = histogram.Snapshot();
+    const double scale = histogram.GetExportScale();
+
+    // Выводим корзины от первой до последней непустой, чтобы не раздувать ответ
+    int first = 0;
+    int last = LOG_BUCKET_COUNT - 1;
+    while (first < LOG_BUCKET_COUNT && counts[first] == 0) {
+        ++first;
+    }
+    while (last >= first && counts[last] == 0) {
+        --last;
+    }
+
+    uint64_t cumulative = 0;
+    for (int i = first; i <= last; ++i) {
+        cumulative += counts[i];
+        std::ostringstream le;
+        le.precision(10);
+        le << "le=\""s << LogBucketUpperBound(i) * scale << "\""s;
+        out << name << "_bucket"s << FormatLabels(labels, le.str()) << " "s << cumulative << "\n"s;
+    }
+    out << name << "_bucket"s << FormatLabels(labels, "le=\"+Inf\""s) << " "s << cumulative << "\n"s;
+    out << name << "_sum"s << FormatLabels(labels) << " "s << histogram.Sum() * scale << "\n"s;
+    out << name << "_count"s << FormatLabels(labels) << " "s << cumulative << "\n"s;
+}
+
+} // namespace
+
+void MetricsRegistry::WritePrometheus(std::ostream& out) const {
+    std::lock_guard guard(mutex_);
+    const auto precision = out.precision(10);
+
+    for (const auto& [name, family] : families_) {
+        out << "# HELP "s << name << " "s << family.help << "\n"s;
+        switch (family.type) {
+        case MetricType::COUNTER:
+            out << "# TYPE "s << name << " counter\n"s;
+            for (const auto& [labels, counter] : family.counters) {
+                out << name << FormatLabels(labels) << " "s << counter->Value() << "\n"s;
+            }
+            break;
+        case MetricType::GAUGE:
+            out << "# TYPE "s << name << " gauge\n"s;
+            for (const auto& [labels, gauge] : family.gauges) {
+                out << name << FormatLabels(labels) << " "s << gauge->Value() << "\n"s;
+            }
+            break;
+        case MetricType::HISTOGRAM:
+            out << "# TYPE "s << name << " histogram\n"s;
+            for (const auto& [labels, histogram] : family.histograms) {
+                WriteHistogram(out, name, labels, *histogram);
+            }
+            break;
+        }
+    }
+
+    out.precision(precision);
+}
+
+void MetricsRegistry::ExportPrometheus(const std::string& path) const {
+    const std::string tmp_path = path + ".tmp"s;
+    {
+        std::ofstream out(tmp_path);
+        if (!out) {
+            throw std::runtime_error("Cannot open metrics file "s + tmp_path);
+        }
+        WritePrometheus(out);
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Cannot write metrics file "s + path);
+    }
+}
+
+/*
+Реализация PrometheusHttpExporter
+*/
+
+PrometheusHttpExporter::PrometheusHttpExporter(const MetricsRegistry& registry, uint16_t port)
+    : registry_(registry) {
+    socket_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (socket_fd_ < 0) {
+        throw std::runtime_error("Cannot create metrics socket"s);
+    }
+    const int enable = 1;
+    setsockopt(socket_fd_, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(socket_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+        || listen(socket_fd_, 16) != 0) {
+        close(socket_fd_);
+        throw std::runtime_error("Cannot listen on metrics port "s + std::to_string(port));
+    }
+    if (pipe(wake_fds_) != 0) {
+        close(socket_fd_);
+        throw std::runtime_error("Cannot create metrics wake-up pipe"s);
+    }
+
+    thread_ = std::thread([this] { Serve(); });
+}
+
+PrometheusHttpExporter::~PrometheusHttpExporter() {
+    const char signal = 0;
+    [[maybe_unused]] const auto result = write(wake_fds_[1], &signal, 1);
+    thread_.join();
+    close(socket_fd_);
+    close(wake_fds_[0]);
+    close(wake_fds_[1]);
+}
+
+void PrometheusHttpExporter::Serve() {
+    const auto forever = std::chrono::steady_clock::time_point::max();
+    while (WaitFor(socket_fd_, POLLIN, forever)) {
+        const int client_fd = accept(socket_fd_, nullptr, nullptr);
+        if (client_fd < 0) {
+            continue;
+        }
+        ServeClient(client_fd);
+        close(client_fd);
+    }
+}
+
+void PrometheusHttpExporter::ServeClient(int client_fd) {
+    const auto deadline = std::chrono::steady_clock::now() + CLIENT_TIMEOUT;
+
+    // Содержимое запроса не разбираем: любой запрос получает актуальные метрики
+    char request[4096];
+    if (!WaitFor(client_fd, POLLIN, deadline) || read(client_fd, request, sizeof(request)) <= 0) {
+        return;
+    }
+
+    std::ostringstream body;
+    registry_.WritePrometheus(body);
+    const std::string content = body.str();
+    const std::string response = "HTTP/1.1 200 OK\r\n"s
+        + "Content-Type: text/plain; version=0.0.4\r\n"s
+        + "Content-Length: "s + std::to_string(content.size()) + "\r\n"s
+        + "Connection: close\r\n\r\n"s + content;
+
+    size_t written = 0;
+    while (written < response.size() && WaitFor(client_fd, POLLOUT, deadline)) {
+        const auto result = send(client_fd, response.data() + written, response.size() - written, MSG_NOSIGNAL);
+        if (result <= 0) {
+            return;
+        }
+        written += result;
+    }
+}
+
+bool PrometheusHttpExporter::WaitFor(int fd, short events, std::chrono::steady_clock::time_point deadline) const {
+    while (true) {
+        int timeout_ms = -1;
+        if (deadline != std::chrono::steady_clock::time_point::max()) {
+            const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now());
+            if (left.count() <= 0) {
+                return false;
+            }
+            timeout_ms = static_cast<int>(std::min<int64_t>(left.count(), 60'000));
+        }
+
+        pollfd fds[] = { { fd, events, 0 }, { wake_fds_[0], POLLIN, 0 } };
+        const int ready = poll(fds, 2, timeout_ms);
+        if (ready < 0 && errno != EINTR) {
+            return false;
+        }
+        if (fds[1].revents != 0) {
+            return false;
+        }
+        if (fds[0].revents != 0) {
+            return true;
+        }
+    }
+}
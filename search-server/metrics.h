@@ -0,0 +1,211 @@
+#pragma once
+
+#include "histogram.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+#define METRICS_CONCAT_INTERNAL(X, Y) X##Y
+#define METRICS_CONCAT(X, Y) METRICS_CONCAT_INTERNAL(X, Y)
+#define UNIQUE_VAR_NAME_METRICS METRICS_CONCAT(metricsGuard, __LINE__)
+
+// Сборку без метрик можно получить, определив SEARCH_SERVER_NO_METRICS: замеры не выполняются,
+// а обновление счетчиков, показателей и гистограмм ничего не делает
+#ifdef SEARCH_SERVER_NO_METRICS
+#define METRIC_DURATION(histogram)
+#else
+#define METRIC_DURATION(histogram) ScopedMetricTimer UNIQUE_VAR_NAME_METRICS(histogram)
+#endif
+
+// Количество шардов: потоки распределяются по ним, чтобы не делить одну кэш-линию
+constexpr size_t METRIC_SHARD_COUNT = 16;
+
+// Номер шарда текущего потока (назначается по кругу при первом обращении)
+size_t CurrentMetricShard();
+
+/*
+Монотонно возрастающий счетчик
+*/
+
+class MetricCounter {
+public:
+    void Increment([[maybe_unused]] uint64_t delta = 1) {
+#ifndef SEARCH_SERVER_NO_METRICS
+        shards_[CurrentMetricShard()].value.fetch_add(delta, std::memory_order_relaxed);
+#endif
+    }
+
+    uint64_t Value() const;
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> value{ 0 };
+    };
+    std::array<Shard, METRIC_SHARD_COUNT> shards_;
+};
+
+/*
+Текущее значение величины (размер индекса, число документов и т.п.)
+*/
+
+class MetricGauge {
+public:
+    void Set([[maybe_unused]] double value) {
+#ifndef SEARCH_SERVER_NO_METRICS
+        value_.store(value, std::memory_order_relaxed);
+#endif
+    }
+
+    void Add(double delta);
+
+    double Value() const {
+        return value_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<double> value_{ 0.0 };
+};
+
+/*
+Гистограмма с логарифмическими корзинами, значения хранятся в целых единицах
+(для длительностей - наносекунды), при экспорте умножаются на export_scale
+*/
+
+class MetricHistogram {
+public:
+    explicit MetricHistogram(double export_scale = 1.0) : export_scale_(export_scale) {}
+
+    void Observe([[maybe_unused]] uint64_t value) {
+#ifndef SEARCH_SERVER_NO_METRICS
+        Shard& shard = shards_[CurrentMetricShard()];
+        shard.counts.Add(value);
+        shard.sum.fetch_add(value, std::memory_order_relaxed);
+#endif
+    }
+
+    LogHistogramSnapshot Snapshot() const;
+
+    uint64_t Count() const;
+
+    uint64_t Sum() const;
+
+    // Перцентиль в единицах экспорта
+    double Percentile(double percentile) const;
+
+    double GetExportScale() const {
+        return export_scale_;
+    }
+
+private:
+    struct alignas(64) Shard {
+        AtomicLogHistogram<uint64_t> counts;
+        std::atomic<uint64_t> sum{ 0 };
+    };
+
+    const double export_scale_;
+    std::array<Shard, METRIC_SHARD_COUNT> shards_;
+};
+
+/*
+Замер длительности области видимости с записью в гистограмму (в наносекундах)
+*/
+
+class ScopedMetricTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit ScopedMetricTimer(MetricHistogram& histogram) : histogram_(histogram) {}
+
+    ~ScopedMetricTimer() {
+        const auto dur = Clock::now() - start_time_;
+        histogram_.Observe(std::chrono::duration_cast<std::chrono::nanoseconds>(dur).count());
+    }
+
+private:
+    MetricHistogram& histogram_;
+    const Clock::time_point start_time_ = Clock::now();
+};
+
+/*
+Реестр метрик процесса.
+Метрика идентифицируется именем и строкой меток (например, stage="parse").
+Ссылки на метрики остаются действительными всё время жизни реестра,
+поэтому их можно получить один раз и обновлять без обращения к реестру
+*/
+
+class MetricsRegistry {
+public:
+    static MetricsRegistry& Instance();
+
+    MetricCounter& GetCounter(const std::string& name, const std::string& help,
+                              const std::string& labels = {});
+
+    MetricGauge& GetGauge(const std::string& name, const std::string& help,
+                          const std::string& labels = {});
+
+    MetricHistogram& GetHistogram(const std::string& name, const std::string& help,
+                                  const std::string& labels = {}, double export_scale = 1.0);
+
+    // Экспорт в текстовом формате Prometheus
+    void WritePrometheus(std::ostream& out) const;
+
+    // Атомарная запись в файл (через временный файл и переименование), например для textfile collector
+    void ExportPrometheus(const std::string& path) const;
+
+private:
+    enum class MetricType { COUNTER, GAUGE, HISTOGRAM };
+
+    struct Family {
+        MetricType type;
+        std::string help;
+        std::map<std::string, std::unique_ptr<MetricCounter>> counters;
+        std::map<std::string, std::unique_ptr<MetricGauge>> gauges;
+        std::map<std::string, std::unique_ptr<MetricHistogram>> histograms;
+    };
+
+    mutable std::mutex mutex_;
+    std::map<std::string, Family> families_;
+
+    Family& GetFamily(const std::string& name, const std::string& help, MetricType type);
+};
+
+/*
+Локальная HTTP-точка, отдающая метрики реестра по запросу GET /metrics.
+Клиент, который не прислал запрос или не читает ответ за CLIENT_TIMEOUT, отключается.
+Деструктор будит поток через служебный канал, не дожидаясь клиента или нового соединения
+*/
+
+class PrometheusHttpExporter {
+public:
+    static constexpr std::chrono::milliseconds CLIENT_TIMEOUT{ 2'000 };
+
+    // Слушает 127.0.0.1:port в отдельном потоке
+    PrometheusHttpExporter(const MetricsRegistry& registry, uint16_t port);
+
+    PrometheusHttpExporter(const PrometheusHttpExporter&) = delete;
+    PrometheusHttpExporter& operator=(const PrometheusHttpExporter&) = delete;
+
+    ~PrometheusHttpExporter();
+
+private:
+    const MetricsRegistry& registry_;
+    int socket_fd_ = -1;
+    // Канал остановки: деструктор пишет в wake_fds_[1], поток ждет его наравне с сокетами
+    int wake_fds_[2] = { -1, -1 };
+    std::thread thread_;
+
+    void Serve();
+
+    void ServeClient(int client_fd);
+
+    // Ожидание события events на fd не дольше deadline; false - время вышло или пора остановиться
+    bool WaitFor(int fd, short events, std::chrono::steady_clock::time_point deadline) const;
+};
@@ -1,6 +1,12 @@
 #pragma once
 
+#include "document.h"
+#include "search_server.h"
+
 #include <iostream>
+#include <iterator>
+#include <optional>
+#include <string>
 #include <cmath>
 
 using std::literals::string_literals::operator""s;
@@ -9,7 +15,7 @@ template <typename Iterator>
 class IteratorRange {
 public:
     IteratorRange(Iterator begin, Iterator end) : it_begin_(begin), it_end_(end) {}
-    
+
     Iterator begin() const {
         return it_begin_;
     }
@@ -24,44 +30,84 @@ private:
     Iterator it_end_;
 };
 
+/*
+Постраничное разбиение диапазона.
+Страницы не хранятся, а вычисляются при переходе итератора к следующей странице
+*/
+
 template <typename Iterator>
 class Paginator {
 public:
-    Paginator<Iterator> (const Iterator& it_page_begin, const Iterator& it_page_end, size_t page_size) {
+    class PageIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = IteratorRange<Iterator>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = IteratorRange<Iterator>;
+
+        PageIterator(Iterator page_begin, Iterator range_end, size_t page_size)
+            : page_begin_(page_begin), range_end_(range_end), page_size_(page_size) {}
+
+        IteratorRange<Iterator> operator*() const {
+            return IteratorRange(page_begin_, PageEnd());
+        }
+
+        PageIterator& operator++() {
+            page_begin_ = PageEnd();
+            return *this;
+        }
+
+        PageIterator operator++(int) {
+            PageIterator copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        bool operator==(const PageIterator& other) const {
+            return page_begin_ == other.page_begin_;
+        }
+        bool operator!=(const PageIterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        Iterator page_begin_;
+        Iterator range_end_;
+        size_t page_size_;
+
+        Iterator PageEnd() const {
+            // Последняя страница может быть неполной
+            const auto rest = static_cast<size_t>(distance(page_begin_, range_end_));
+            return std::next(page_begin_, std::min(rest, page_size_));
+        }
+    };
+
+    Paginator<Iterator> (const Iterator& it_page_begin, const Iterator& it_page_end, size_t page_size)
+        : it_page_begin_(it_page_begin), it_page_end_(it_page_end), page_size_(page_size) {
         if (page_size < 1) {
             throw std::invalid_argument("Page size cannot be smaller than 1");
         }
         if (it_page_end <= it_page_begin) {
             throw std::invalid_argument("Pagination error");
         }
-
-        // Узнаем на скольких страницах поместятся все запросы
-        size_t number_of_pages = ceil((distance(
-            it_page_begin, it_page_end) / static_cast<double>(page_size)));
-            
-        for (size_t i = 0; i < number_of_pages; ++i) {
-            // Разделяем результаты постранично
-            if (distance(it_page_begin + page_size * i, it_page_end) > page_size) {
-                pages_.push_back(IteratorRange(
-                    it_page_begin + page_size * i, it_page_begin + page_size * (i + 1)));
-            } else { // Оставшиеся результаты
-                pages_.push_back(IteratorRange(it_page_begin + page_size * i, it_page_end));
-            }
-        }
     }
-    
+
     auto begin() const {
-        return pages_.begin();
+        return PageIterator(it_page_begin_, it_page_end_, page_size_);
     }
     auto end() const {
-        return pages_.end();
+        return PageIterator(it_page_end_, it_page_end_, page_size_);
     }
     auto size() const {
-        return pages_.size();
+        // Узнаем на скольких страницах поместятся все запросы
+        return static_cast<size_t>(ceil(distance(it_page_begin_, it_page_end_) / static_cast<double>(page_size_)));
     }
-    
+
 private:
-    std::vector<IteratorRange<Iterator>> pages_;
+    Iterator it_page_begin_;
+    Iterator it_page_end_;
+    size_t page_size_;
 };
 
 template <typename Container>
@@ -69,7 +115,104 @@ auto Paginate(const Container& c, size_t page_size) {
     return Paginator(begin(c), end(c), page_size);
 }
 
-std::ostream& operator<<(std::ostream& out, const Document& doc) {
+/*
+Ленивое постраничное разбиение результатов поиска.
+Каждая следующая страница запрашивается у сервера по курсору (последнему документу
+предыдущей страницы), поэтому полный список результатов не строится и не хранится
+*/
+
+template <typename DocumentPredicate>
+class SearchPaginator {
+public:
+    class PageIterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::vector<Document>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const std::vector<Document>*;
+        using reference = const std::vector<Document>&;
+
+        PageIterator() = default;
+
+        PageIterator(const SearchPaginator* paginator, std::vector<Document> page)
+            : paginator_(paginator), page_(std::move(page)) {}
+
+        const std::vector<Document>& operator*() const {
+            return page_;
+        }
+        const std::vector<Document>* operator->() const {
+            return &page_;
+        }
+
+        PageIterator& operator++() {
+            // Неполная страница - последняя, лишний запрос к серверу не нужен
+            if (page_.size() < paginator_->page_size_) {
+                page_.clear();
+            } else {
+                page_ = paginator_->GetPageAfter(page_.back());
+            }
+            return *this;
+        }
+
+        // Итераторы равны, если оба достигли конца выдачи
+        bool operator==(const PageIterator& other) const {
+            return page_.empty() && other.page_.empty();
+        }
+        bool operator!=(const PageIterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        const SearchPaginator* paginator_ = nullptr;
+        std::vector<Document> page_;
+    };
+
+    SearchPaginator(const SearchServer& search_server, std::string_view raw_query,
+                    DocumentPredicate document_predicate, size_t page_size)
+        : search_server_(search_server)
+        , raw_query_(raw_query)
+        , document_predicate_(document_predicate)
+        , page_size_(page_size) {
+        if (page_size < 1) {
+            throw std::invalid_argument("Page size cannot be smaller than 1");
+        }
+    }
+
+    PageIterator begin() const {
+        return PageIterator(this, GetPage(std::nullopt));
+    }
+    PageIterator end() const {
+        return PageIterator();
+    }
+
+    // Страница, следующая за документом cursor (например, для бесконечной прокрутки)
+    std::vector<Document> GetPageAfter(const Document& cursor) const {
+        return GetPage(cursor);
+    }
+
+private:
+    const SearchServer& search_server_;
+    const std::string raw_query_;
+    DocumentPredicate document_predicate_;
+    size_t page_size_;
+
+    std::vector<Document> GetPage(const std::optional<Document>& cursor) const {
+        return search_server_.FindDocumentsAfter(std::execution::seq, raw_query_,
+                                                 document_predicate_, cursor, page_size_);
+    }
+};
+
+template <typename DocumentPredicate>
+auto PaginateSearch(const SearchServer& search_server, std::string_view raw_query,
+                    DocumentPredicate document_predicate, size_t page_size) {
+    return SearchPaginator<DocumentPredicate>(search_server, raw_query, document_predicate, page_size);
+}
+
+inline auto PaginateSearch(const SearchServer& search_server, std::string_view raw_query, size_t page_size) {
+    return PaginateSearch(search_server, raw_query, DocumentFilter{}, page_size);
+}
+
+inline std::ostream& operator<<(std::ostream& out, const Document& doc) {
     out << "{ document_id = "s << doc.id;
     out << ", relevance = "s << doc.relevance;
     out << ", rating = "s << doc.rating << " }"s;
@@ -82,4 +225,4 @@ std::ostream& operator<<(std::ostream& out, const IteratorRange<Iterator>& range
         out << *it;
     }
     return out;
-}
\ No newline at end of file
+}
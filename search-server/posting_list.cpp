@@ -0,0 +1,135 @@
+#include "posting_list.h"
+
+#include <functional>
+#include <queue>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Во сколько раз длинный массив должен превосходить короткий, чтобы галоп был выгоднее слияния
+constexpr size_t GALLOP_RATIO = 32;
+
+size_t IntersectGalloping(const int* small, size_t small_size, const int* large, size_t large_size, int* out) {
+    size_t count = 0;
+    const int* position = large;
+    const int* const large_end = large + large_size;
+    for (size_t i = 0; i < small_size; ++i) {
+        position = GallopLowerBound(position, large_end, small[i]);
+        if (position == large_end) {
+            break;
+        }
+        if (*position == small[i]) {
+            out[count++] = small[i];
+        }
+    }
+    return count;
+}
+
+size_t IntersectMerge(const int* lhs, size_t lhs_size, const int* rhs, size_t rhs_size, int* out) {
+    size_t count = 0;
+    size_t i = 0;
+    size_t j = 0;
+
+#if defined(__SSE2__)
+    // Каждый элемент блока lhs сравнивается со всеми четырьмя элементами блока rhs
+    // (исходный блок и три его циклических сдвига)
+    while (i + 4 <= lhs_size && j + 4 <= rhs_size) {
+        const __m128i lhs_block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs + i));
+        const __m128i rhs_block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs + j));
+        const __m128i equal_0 = _mm_cmpeq_epi32(lhs_block, rhs_block);
+        const __m128i equal_1 = _mm_cmpeq_epi32(lhs_block, _mm_shuffle_epi32(rhs_block, _MM_SHUFFLE(0, 3, 2, 1)));
+        const __m128i equal_2 = _mm_cmpeq_epi32(lhs_block, _mm_shuffle_epi32(rhs_block, _MM_SHUFFLE(1, 0, 3, 2)));
+        const __m128i equal_3 = _mm_cmpeq_epi32(lhs_block, _mm_shuffle_epi32(rhs_block, _MM_SHUFFLE(2, 1, 0, 3)));
+        const int mask = _mm_movemask_ps(_mm_castsi128_ps(
+            _mm_or_si128(_mm_or_si128(equal_0, equal_1), _mm_or_si128(equal_2, equal_3))));
+
+        // Границы блоков читаются до записи: out может совпадать с lhs
+        const int lhs_max = lhs[i + 3];
+        const int rhs_max = rhs[j + 3];
+        for (int bit = 0; bit < 4; ++bit) {
+            if (mask & (1 << bit)) {
+                out[count++] = lhs[i + bit];
+            }
+        }
+
+        if (lhs_max <= rhs_max) {
+            i += 4;
+        }
+        if (rhs_max <= lhs_max) {
+            j += 4;
+        }
+    }
+#endif
+
+    while (i < lhs_size && j < rhs_size) {
+        if (lhs[i] < rhs[j]) {
+            ++i;
+        } else if (rhs[j] < lhs[i]) {
+            ++j;
+        } else {
+            out[count++] = lhs[i];
+            ++i;
+            ++j;
+        }
+    }
+    return count;
+}
+
+} // namespace
+
+const int* GallopLowerBound(const int* first, const int* last, int value) {
+    size_t step = 1;
+    while (static_cast<size_t>(last - first) > step && first[step] < value) {
+        first += step;
+        step *= 2;
+    }
+    const int* bound = static_cast<size_t>(last - first) > step ? first + step : last;
+    return std::lower_bound(first, bound, value);
+}
+
+void UniteSorted(const std::vector<ArrayView<int>>& lists, std::vector<int>& out) {
+    out.clear();
+    if (lists.size() == 1) {
+        out.assign(lists.front().begin(), lists.front().end());
+        return;
+    }
+    
+    // Куча текущих элементов списков: значение и номер списка
+    using Cursor = std::pair<int, size_t>;
+    std::priority_queue<Cursor, std::vector<Cursor>, std::greater<>> heads;
+    std::vector<size_t> positions(lists.size(), 0);
+    size_t total = 0;
+    for (size_t i = 0; i < lists.size(); ++i) {
+        total += lists[i].size();
+        if (!lists[i].empty()) {
+            heads.emplace(lists[i][0], i);
+        }
+    }
+    out.reserve(total);
+    while (!heads.empty()) {
+        const auto [value, list] = heads.top();
+        heads.pop();
+        if (out.empty() || out.back() != value) {
+            out.push_back(value);
+        }
+        if (++positions[list] < lists[list].size()) {
+            heads.emplace(lists[list][positions[list]], list);
+        }
+    }
+}
+
+size_t IntersectSorted(const int* lhs, size_t lhs_size, const int* rhs, size_t rhs_size, int* out) {
+    if (lhs_size == 0 || rhs_size == 0) {
+        return 0;
+    }
+    if (rhs_size / lhs_size >= GALLOP_RATIO) {
+        return IntersectGalloping(lhs, lhs_size, rhs, rhs_size, out);
+    }
+    if (lhs_size / rhs_size >= GALLOP_RATIO) {
+        return IntersectGalloping(rhs, rhs_size, lhs, lhs_size, out);
+    }
+    return IntersectMerge(lhs, lhs_size, rhs, rhs_size, out);
+}
@@ -0,0 +1,260 @@
+#pragma once
+
+#include "array_view.h"
+#include "memory_usage.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/*
+Список вхождений слова: порядковые номера документов по возрастанию и частоты слова (TF).
+Номера и частоты хранятся в отдельных массивах, поэтому пересечение списков
+проходит только по плотному массиву номеров.
+Если индекс хранит позиции, позиции слова в каждом документе записываются в общий байтовый
+массив разностями в кодировке varint. Массивы позиций выделяются отдельно при первой позиции:
+списки лежат в векторе по ID термина, и без позиций каждый занимает меньше места
+*/
+
+class PostingList {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<int, double>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        Iterator(const PostingList* list, size_t index) : list_(list), index_(index) {}
+
+        value_type operator*() const {
+            return { list_->ordinals_[index_], list_->term_freqs_[index_] };
+        }
+
+        Iterator& operator++() {
+            ++index_;
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return index_ == other.index_;
+        }
+        bool operator!=(const Iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        const PostingList* list_;
+        size_t index_;
+    };
+
+    // Порядковые номера выдаются по возрастанию, поэтому новый документ всегда дописывается в конец
+    void Add(int ordinal, double term_freq) {
+        if (!ordinals_.empty() && ordinals_.back() == ordinal) {
+            term_freqs_.back() += term_freq;
+            return;
+        }
+        ordinals_.push_back(ordinal);
+        term_freqs_.push_back(term_freq);
+    }
+
+    // Добавление очередного вхождения с позицией; max_positions ограничивает число
+    // сохраняемых позиций слова в одном документе (0 - без ограничения)
+    void Add(int ordinal, double term_freq, uint32_t position, size_t max_positions) {
+        if (!positions_) {
+            positions_ = std::make_unique<Positions>();
+        }
+        Positions& positions = *positions_;
+        if (ordinals_.empty() || ordinals_.back() != ordinal) {
+            positions.offsets.push_back(static_cast<uint32_t>(positions.bytes.size()));
+            positions.last_position = 0;
+            positions.last_count = 0;
+        }
+        Add(ordinal, term_freq);
+        if (max_positions == 0 || positions.last_count < max_positions) {
+            AppendVarint(positions.bytes, position - positions.last_position);
+            positions.last_position = position;
+            ++positions.last_count;
+        }
+    }
+
+    // Удаление оставляет запись в массивах и только уменьшает число живых документов:
+    // удаленный документ уже сброшен во всех битовых картах статусов, и обход индекса его
+    // отбрасывает. Записи удаленных документов вычищаются разом в Renumber
+    size_t Erase(int ordinal) {
+        if (Find(ordinal) == NPOS) {
+            return 0;
+        }
+        ++erased_count_;
+        return 1;
+    }
+
+    // Перенумерация документов: new_ordinals[n] - новый номер документа n или -1, если он удален.
+    // Новые номера должны сохранять порядок старых, а все удаленные через Erase получать -1
+    void Renumber(const std::vector<int>& new_ordinals) {
+        size_t size = 0;
+        uint32_t position_size = 0;
+        for (size_t i = 0; i < ordinals_.size(); ++i) {
+            const int ordinal = new_ordinals[ordinals_[i]];
+            if (ordinal < 0) {
+                continue;
+            }
+            if (HasPositions()) {
+                std::vector<uint8_t>& bytes = positions_->bytes;
+                const uint32_t begin = positions_->offsets[i];
+                const uint32_t end = GetPositionsEnd(i);
+                std::copy(bytes.begin() + begin, bytes.begin() + end, bytes.begin() + position_size);
+                positions_->offsets[size] = position_size;
+                position_size += end - begin;
+            }
+            ordinals_[size] = ordinal;
+            term_freqs_[size] = term_freqs_[i];
+            ++size;
+        }
+        ordinals_.resize(size);
+        term_freqs_.resize(size);
+        if (HasPositions()) {
+            positions_->offsets.resize(size);
+            positions_->bytes.resize(position_size);
+        }
+        erased_count_ = 0;
+    }
+
+    static constexpr size_t NPOS = static_cast<size_t>(-1);
+
+    // Позиция документа в списке или NPOS, если слова в документе нет
+    size_t Find(int ordinal) const {
+        const auto it = std::lower_bound(ordinals_.begin(), ordinals_.end(), ordinal);
+        if (it == ordinals_.end() || *it != ordinal) {
+            return NPOS;
+        }
+        return it - ordinals_.begin();
+    }
+
+    bool Contains(int ordinal) const {
+        return Find(ordinal) != NPOS;
+    }
+
+    // Число живых документов (для IDF)
+    size_t Size() const {
+        return ordinals_.size() - erased_count_;
+    }
+
+    bool Empty() const {
+        return Size() == 0;
+    }
+
+    // Номера документов вместе с удаленными, которые еще не вычищены перенумерацией
+    const std::vector<int>& GetOrdinals() const {
+        return ordinals_;
+    }
+
+    double GetTermFreq(size_t position) const {
+        return term_freqs_[position];
+    }
+
+    bool HasPositions() const {
+        return positions_ != nullptr;
+    }
+
+    // Позиции слова в документе с индексом index в списке, по возрастанию
+    void GetPositions(size_t index, std::vector<int>& positions) const {
+        positions.clear();
+        size_t offset = positions_->offsets[index];
+        const size_t end = GetPositionsEnd(index);
+        uint32_t position = 0;
+        while (offset < end) {
+            uint32_t delta = 0;
+            for (int shift = 0;; shift += 7) {
+                const uint8_t byte = positions_->bytes[offset++];
+                delta |= static_cast<uint32_t>(byte & 0x7F) << shift;
+                if ((byte & 0x80) == 0) {
+                    break;
+                }
+            }
+            position += delta;
+            positions.push_back(static_cast<int>(position));
+        }
+    }
+
+    Iterator begin() const {
+        return Iterator(this, 0);
+    }
+    Iterator end() const {
+        return Iterator(this, ordinals_.size());
+    }
+
+    // Прирост памяти массивов при добавлении документа (позиции - с расчетом на positions_bytes байтов)
+    size_t GetGrowthBytes(size_t positions_bytes) const {
+        size_t bytes = GetVectorGrowthBytes(ordinals_, 1) + GetVectorGrowthBytes(term_freqs_, 1);
+        if (HasPositions()) {
+            bytes += GetVectorGrowthBytes(positions_->offsets, 1)
+                + GetVectorGrowthBytes(positions_->bytes, positions_bytes);
+        }
+        return bytes;
+    }
+
+    // Память массивов списка; объекты - число документов в списке
+    MemoryUsage GetMemoryUsage() const {
+        MemoryUsage usage = GetVectorMemoryUsage(ordinals_);
+        usage += GetVectorMemoryUsage(term_freqs_);
+        if (HasPositions()) {
+            usage.bytes += sizeof(Positions);
+            usage.overhead_bytes += ALLOCATION_OVERHEAD;
+            usage += GetVectorMemoryUsage(positions_->offsets);
+            usage += GetVectorMemoryUsage(positions_->bytes);
+        }
+        usage.objects = ordinals_.size();
+        return usage;
+    }
+
+private:
+    struct Positions {
+        // Начало позиций каждого документа в bytes
+        std::vector<uint32_t> offsets;
+        std::vector<uint8_t> bytes;
+        // Состояние последнего документа, которому дописываются позиции
+        uint32_t last_position = 0;
+        uint32_t last_count = 0;
+    };
+
+    std::vector<int> ordinals_;
+    std::vector<double> term_freqs_;
+    std::unique_ptr<Positions> positions_;
+    // Записи удаленных документов, оставшиеся в массивах
+    uint32_t erased_count_ = 0;
+
+    // Конец позиций документа с индексом index в positions_->bytes
+    uint32_t GetPositionsEnd(size_t index) const {
+        return index + 1 < positions_->offsets.size() ? positions_->offsets[index + 1]
+                                                      : static_cast<uint32_t>(positions_->bytes.size());
+    }
+
+    static void AppendVarint(std::vector<uint8_t>& bytes, uint32_t value) {
+        while (value >= 0x80) {
+            bytes.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        bytes.push_back(static_cast<uint8_t>(value));
+    }
+};
+
+/*
+Пересечение отсортированных массивов без повторов.
+Результат записывается в out (может совпадать с lhs), возвращается его длина.
+При сильно различающихся длинах используется галопирующий поиск по длинному массиву,
+при сопоставимых - поблочное сравнение по 4 элемента (SSE2, если доступно)
+*/
+
+size_t IntersectSorted(const int* lhs, size_t lhs_size, const int* rhs, size_t rhs_size, int* out);
+
+// Объединение отсортированных массивов без повторов в out (k-путевое слияние кучей)
+void UniteSorted(const std::vector<ArrayView<int>>& lists, std::vector<int>& out);
+
+// Первая позиция в [first, last) со значением не меньше value, поиск шагами 1, 2, 4, ...
+const int* GallopLowerBound(const int* first, const int* last, int value);
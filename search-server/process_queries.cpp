@@ -1,19 +1,56 @@
 #include "process_queries.h"
 
-std::vector<std::vector<Document>> ProcessQueries(
-    const SearchServer& search_server, const std::vector<std::string>& queries) {
-    
+#include <exception>
+#include <mutex>
+
+namespace {
+
+// Исключение, вылетевшее из параллельного алгоритма, вызывает std::terminate, поэтому
+// первое из них запоминается и пробрасывается после обработки всех запросов
+template <typename Function>
+std::vector<std::vector<Document>> TransformQueries(const std::vector<std::string>& queries, Function function) {
     std::vector<std::vector<Document>> result_queries(queries.size());
+    std::mutex failure_mutex;
+    std::exception_ptr failure;
     
     std::transform(std::execution::par, queries.begin(), queries.end(), 
                    result_queries.begin(),
-                   [&search_server](const std::string& query) {
-                       return search_server.FindTopDocuments(query);
+                   [&function, &failure_mutex, &failure](const std::string& query) {
+                       try {
+                           return function(query);
+                       } catch (...) {
+                           std::lock_guard guard(failure_mutex);
+                           if (!failure) {
+                               failure = std::current_exception();
+                           }
+                           return std::vector<Document>{};
+                       }
                    });
     
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
     return result_queries;
 }
 
+} // namespace
+
+std::vector<std::vector<Document>> ProcessQueries(
+    const SearchServer& search_server, const std::vector<std::string>& queries) {
+    
+    return TransformQueries(queries, [&search_server](const std::string& query) {
+        return search_server.FindTopDocuments(query);
+    });
+}
+
+std::vector<std::vector<Document>> ProcessQueries(
+    RequestQueue& request_queue, const std::vector<std::string>& queries) {
+    
+    return TransformQueries(queries, [&request_queue](const std::string& query) {
+        return request_queue.AddFindRequest(query);
+    });
+}
+
 std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server, const std::vector<std::string>& queries) {
     
@@ -5,10 +5,15 @@
 #include <vector>
 
 #include "search_server.h"
+#include "request_queue.h"
 #include "document.h"
 
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server, const std::vector<std::string>& queries);
 
 std::vector<Document> ProcessQueriesJoined(
-    const SearchServer& search_server, const std::vector<std::string>& queries);
\ No newline at end of file
+    const SearchServer& search_server, const std::vector<std::string>& queries);
+
+// Запросы выполняются параллельно, каждый рабочий поток регистрирует результат в request_queue
+std::vector<std::vector<Document>> ProcessQueries(
+    RequestQueue& request_queue, const std::vector<std::string>& queries);
\ No newline at end of file
@@ -1,6 +1,9 @@
 #include "read_input_functions.h"
 
 #include <iostream>
+#include <stdexcept>
+
+using std::literals::string_literals::operator""s;
 
 std::string ReadLine() {
     std::string s;
@@ -13,4 +16,38 @@ int ReadLineWithNumber() {
     std::cin >> result;
     ReadLine();
     return result;
+}
+
+LineBlockReader::LineBlockReader(std::FILE* input, size_t block_size)
+    : input_(input)
+    , block_size_(block_size) {
+    if (block_size_ == 0) {
+        throw std::invalid_argument("Block size must be positive"s);
+    }
+}
+
+bool LineBlockReader::ReadBlock(std::string& block) {
+    block.swap(tail_);
+    tail_.clear();
+    while (!finished_) {
+        const size_t begin = block.size();
+        block.resize(begin + block_size_);
+        const size_t read = std::fread(block.data() + begin, 1, block_size_, input_);
+        block.resize(begin + read);
+        if (read < block_size_) {
+            if (std::ferror(input_)) {
+                throw std::runtime_error("Failed to read input"s);
+            }
+            finished_ = true;
+            break;
+        }
+        // Неполная последняя строка ждет следующего блока
+        const size_t line_end = block.rfind('\n');
+        if (line_end != std::string::npos) {
+            tail_.assign(block, line_end + 1);
+            block.resize(line_end + 1);
+            return true;
+        }
+    }
+    return !block.empty();
 }
\ No newline at end of file
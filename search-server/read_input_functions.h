@@ -1,7 +1,32 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdio>
 #include <string>
 
 std::string ReadLine();
 
-int ReadLineWithNumber();
\ No newline at end of file
+int ReadLineWithNumber();
+
+/*
+Чтение потока крупными блоками целых строк: вместо getline на каждую строку - один fread
+на блок. Хвост без перевода строки переносится в начало следующего блока, строка длиннее
+блока читается целиком за несколько fread
+*/
+
+class LineBlockReader {
+public:
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 4 * 1024 * 1024;
+
+    explicit LineBlockReader(std::FILE* input, size_t block_size = DEFAULT_BLOCK_SIZE);
+
+    // Следующий блок строк (последняя строка потока может быть без перевода строки).
+    // false - поток закончился; при ошибке чтения - std::runtime_error
+    bool ReadBlock(std::string& block);
+
+private:
+    std::FILE* input_;
+    size_t block_size_;
+    std::string tail_;
+    bool finished_ = false;
+};
@@ -1,19 +1,137 @@
 #include "request_queue.h"
 
-RequestQueue::RequestQueue(const SearchServer& search_server)
-    : search_server_(search_server) {}
+#include <algorithm>
+#include <thread>
+
+RequestQueue::RequestQueue(const SearchServer& search_server, std::chrono::minutes max_window)
+    : search_server_(search_server)
+    , start_time_(Clock::now())
+    , buckets_(std::max<int64_t>(1, max_window.count())) {}
 
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentStatus status) {
-    return AddFindRequest(raw_query,
-                          [status](int document_id, DocumentStatus doc_status, int rating) {
-                              return status == doc_status;
-                          });
+    return AddFindRequest(raw_query, DocumentFilter{ status });
 }
 
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query) {
     return AddFindRequest(raw_query, DocumentStatus::ACTUAL);
 }
 
-int RequestQueue::GetNoResultRequests() const {
-    return unprocessed_requests_;
-}
\ No newline at end of file
+void RequestQueue::RecordRequest(Clock::duration latency, size_t result_count, Clock::time_point now) {
+    Bucket* bucket = AcquireBucket(ToMinute(now));
+    // Запрос старше окна наблюдения уже не учитывается
+    if (bucket == nullptr) {
+        return;
+    }
+
+    bucket->requests.fetch_add(1, std::memory_order_relaxed);
+    if (result_count == 0) {
+        bucket->no_result_requests.fetch_add(1, std::memory_order_relaxed);
+        no_result_total_.fetch_add(1, std::memory_order_relaxed);
+    }
+    const auto latency_us = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    bucket->latencies_us.Add(static_cast<uint64_t>(std::max<int64_t>(0, latency_us)));
+}
+
+RequestStats RequestQueue::GetStats(std::chrono::minutes window, Clock::time_point now) const {
+    const int64_t current_minute = ToMinute(now);
+    const int64_t window_minutes = std::clamp<int64_t>(window.count(), 1, buckets_.size());
+    const int64_t first_minute = current_minute - window_minutes + 1;
+
+    RequestStats stats;
+    LogHistogramSnapshot latencies{};
+    for (const Bucket& bucket : buckets_) {
+        const int64_t minute = bucket.minute.load(std::memory_order_acquire);
+        if (minute < first_minute || minute > current_minute) {
+            continue;
+        }
+        stats.requests += bucket.requests.load(std::memory_order_relaxed);
+        stats.no_result_requests += bucket.no_result_requests.load(std::memory_order_relaxed);
+        bucket.latencies_us.MergeInto(latencies);
+    }
+
+    // Окно не может начинаться раньше запуска очереди
+    const auto window_begin = start_time_ + std::chrono::minutes(std::max<int64_t>(0, first_minute));
+    const double elapsed_seconds = std::chrono::duration<double>(now - window_begin).count();
+    if (elapsed_seconds > 0) {
+        stats.qps = stats.requests / elapsed_seconds;
+    }
+    if (stats.requests > 0) {
+        stats.no_result_rate = static_cast<double>(stats.no_result_requests) / stats.requests;
+    }
+
+    stats.latency_p50 = std::chrono::microseconds(LogHistogramPercentile(latencies, 0.5));
+    stats.latency_p90 = std::chrono::microseconds(LogHistogramPercentile(latencies, 0.9));
+    stats.latency_p99 = std::chrono::microseconds(LogHistogramPercentile(latencies, 0.99));
+    stats.latency_p999 = std::chrono::microseconds(LogHistogramPercentile(latencies, 0.999));
+
+    return stats;
+}
+
+int RequestQueue::GetNoResultRequests(Clock::time_point now) const {
+    const int64_t window = std::min<int64_t>(min_in_day_, buckets_.size());
+    ExpireBuckets(ToMinute(now) - window);
+    return static_cast<int>(std::max<int64_t>(0, no_result_total_.load(std::memory_order_relaxed)));
+}
+
+int64_t RequestQueue::ToMinute(Clock::time_point time) const {
+    return std::chrono::duration_cast<std::chrono::minutes>(time - start_time_).count();
+}
+
+RequestQueue::Bucket* RequestQueue::AcquireBucket(int64_t minute) {
+    if (minute < 0) {
+        return nullptr;
+    }
+    Bucket& bucket = buckets_[minute % buckets_.size()];
+
+    int64_t stamp = bucket.minute.load(std::memory_order_acquire);
+    while (stamp != minute) {
+        if (stamp > minute) {
+            // Корзина уже занята более новой минутой
+            return nullptr;
+        }
+        if (stamp == resetting_minute_) {
+            // Другой поток обнуляет корзину - дожидаемся окончания
+            std::this_thread::yield();
+            stamp = bucket.minute.load(std::memory_order_acquire);
+            continue;
+        }
+        // Первый поток новой минуты захватывает корзину и обнуляет прошлые данные
+        if (bucket.minute.compare_exchange_weak(stamp, resetting_minute_, std::memory_order_acquire)) {
+            ClearBucket(bucket);
+            bucket.minute.store(minute, std::memory_order_release);
+            stamp = minute;
+        }
+    }
+
+    return &bucket;
+}
+
+void RequestQueue::ClearBucket(Bucket& bucket) const {
+    const uint64_t no_result_requests = bucket.no_result_requests.exchange(0, std::memory_order_relaxed);
+    no_result_total_.fetch_sub(static_cast<int64_t>(no_result_requests), std::memory_order_relaxed);
+    bucket.requests.store(0, std::memory_order_relaxed);
+    bucket.latencies_us.Reset();
+}
+
+void RequestQueue::ExpireBuckets(int64_t last_minute) const {
+    int64_t expired = expired_until_.load(std::memory_order_relaxed);
+    do {
+        if (expired >= last_minute) {
+            return;
+        }
+    } while (!expired_until_.compare_exchange_weak(expired, last_minute, std::memory_order_relaxed));
+
+    // Минуты (expired, last_minute] достались этому потоку; в кольце они занимают не больше всех корзин
+    const int64_t count = std::min<int64_t>(last_minute - expired, buckets_.size());
+    for (int64_t minute = last_minute - count + 1; minute <= last_minute; ++minute) {
+        Bucket& bucket = buckets_[minute % buckets_.size()];
+        int64_t stamp = bucket.minute.load(std::memory_order_acquire);
+        while (stamp >= 0 && stamp <= last_minute) {
+            if (bucket.minute.compare_exchange_weak(stamp, resetting_minute_, std::memory_order_acquire)) {
+                ClearBucket(bucket);
+                bucket.minute.store(empty_minute_, std::memory_order_release);
+                break;
+            }
+        }
+    }
+}
@@ -1,14 +1,42 @@
 #pragma once
 
 #include "document.h"
+#include "histogram.h"
 #include "search_server.h" // vector, string
 
-#include <deque>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Сводная статистика запросов за окно времени
+struct RequestStats {
+    uint64_t requests = 0;
+    uint64_t no_result_requests = 0;
+    // Запросов в секунду
+    double qps = 0.0;
+    // Доля запросов с пустым результатом
+    double no_result_rate = 0.0;
+    std::chrono::microseconds latency_p50{0};
+    std::chrono::microseconds latency_p90{0};
+    std::chrono::microseconds latency_p99{0};
+    std::chrono::microseconds latency_p999{0};
+};
+
+/*
+Потокобезопасная очередь запросов.
+Время делится на минутные корзины, которые хранятся в кольцевом буфере фиксированного размера.
+Каждая корзина содержит атомарные счетчики и загрубленную гистограмму задержек, поэтому запись
+из нескольких потоков не требует общей блокировки, а результаты запросов не хранятся.
+Гистограммы минут сводятся в полную шкалу только при чтении статистики
+*/
 
 class RequestQueue {
 public:
-    explicit RequestQueue(const SearchServer& search_server);
-    
+    using Clock = std::chrono::steady_clock;
+
+    explicit RequestQueue(const SearchServer& search_server,
+                          std::chrono::minutes max_window = std::chrono::minutes(min_in_day_));
+
     template <typename DocumentPredicate>
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate);
 
@@ -16,40 +44,62 @@ public:
 
     std::vector<Document> AddFindRequest(const std::string& raw_query);
 
-    int GetNoResultRequests() const;
-    
+    // Регистрация запроса, выполненного в обход очереди (например, рабочими потоками ProcessQueries)
+    void RecordRequest(Clock::duration latency, size_t result_count, Clock::time_point now = Clock::now());
+
+    // Статистика за последние window минут (включая текущую неполную минуту)
+    RequestStats GetStats(std::chrono::minutes window, Clock::time_point now = Clock::now()) const;
+
+    // Количество запросов с пустым результатом за последние сутки (но не больше окна очереди).
+    // Ведется общим счетчиком, поэтому не требует обхода корзин
+    int GetNoResultRequests(Clock::time_point now = Clock::now()) const;
+
 private:
-    struct QueryResult {
-        std::vector<Document> result;
+    static constexpr int min_in_day_ = 1440;
+    // Задержки больше ~2 минут учитываются как ~2 минуты
+    static constexpr uint64_t max_latency_us_ = (uint64_t{1} << 27) - 1;
+    // Метки корзины: ещё не использовалась / сбрасывается другим потоком
+    static constexpr int64_t empty_minute_ = -1;
+    static constexpr int64_t resetting_minute_ = -2;
+
+    // Корзина занимает отдельные кэш-линии, чтобы соседние минуты не мешали друг другу
+    struct alignas(64) Bucket {
+        // Номер минуты от старта очереди, к которой относятся счетчики
+        std::atomic<int64_t> minute{ empty_minute_ };
+        std::atomic<uint64_t> requests{ 0 };
+        std::atomic<uint64_t> no_result_requests{ 0 };
+        AtomicCoarseLogHistogram<uint32_t, max_latency_us_> latencies_us;
     };
-    std::deque<QueryResult> requests_;
-    
+
     const SearchServer& search_server_;
-    
-    const static int min_in_day_ = 1440;
-    // Необработанные запросы
-    int unprocessed_requests_ = 0;
+    const Clock::time_point start_time_;
+    // Устаревшие корзины очищаются и при чтении, поэтому изменяемы в const-методах
+    mutable std::vector<Bucket> buckets_;
+    // Сумма no_result_requests по всем корзинам
+    mutable std::atomic<int64_t> no_result_total_{ 0 };
+    // Корзины с минутами не новее этой уже очищены
+    mutable std::atomic<int64_t> expired_until_{ empty_minute_ };
+
+    int64_t ToMinute(Clock::time_point time) const;
+
+    // Возвращает корзину текущей минуты, при необходимости сбрасывая устаревшие данные
+    Bucket* AcquireBucket(int64_t minute);
+
+    // Обнуление корзины, захваченной меткой resetting_minute_, с вычетом из общего счетчика
+    void ClearBucket(Bucket& bucket) const;
+
+    // Очистка корзин с минутами не новее last_minute. Каждая минута очищается один раз,
+    // поэтому в среднем это O(1) на вызов
+    void ExpireBuckets(int64_t last_minute) const;
 };
 
 template <typename DocumentPredicate>
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
+    const auto start = Clock::now();
     std::vector<Document> result = search_server_.FindTopDocuments(raw_query, document_predicate);
-    // Увеличиваем счетчик необработанных запросов, если результат поиска пустой
-    if (result.empty()) {
-        ++unprocessed_requests_;
-    }
-    // Первый запрос прошлых суток нам больше не интересен и может быть удалён
-    if (requests_.size() >= min_in_day_) {
-        // Последний элемент проверяем на пустоту (т.е. запрос не обработан)
-        if (requests_.back().result.empty()) {
-            // Если результат был пустым, то перед удалением
-            // уменьшаем количество необработанных запросов
-            --unprocessed_requests_;
-        }
-        requests_.pop_back();
-    }
-    
-    requests_.push_front({ result });
-    
+    const auto finish = Clock::now();
+
+    RecordRequest(finish - start, result.size(), finish);
+
     return result;
-}
\ No newline at end of file
+}
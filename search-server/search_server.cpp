@@ -3,6 +3,7 @@
 #include <stdexcept>
 #include <algorithm>
 #include <cmath>
+#include <limits>
 #include <numeric>
 
 using std::literals::string_literals::operator""s;
@@ -13,6 +14,8 @@ using std::literals::string_literals::operator""s;
 
 void SearchServer::AddDocument(int document_id, std::string_view document,
                                DocumentStatus status, const std::vector<int>& ratings) {
+    METRIC_DURATION(GetStageMetrics().ingest);
+    
     // Првоерка на спец.символы в док-те
     if (!IsValidWord(document)) {
         throw std::invalid_argument("Document contains special symbols"s);
@@ -22,27 +25,82 @@ void SearchServer::AddDocument(int document_id, std::string_view document,
         throw std::invalid_argument("Document ID is invalid"s);
     }
     // Проверка на имеющийся ID док-та
-    if (documents_.count(document_id) > 0) {
+    if (document_ordinals_.count(document_id) > 0) {
         throw std::invalid_argument("Document ID is already exist"s);
     }
+    
+    // Позиция слова считается среди всех слов док-та, включая стоп-слова
+    const auto words = SplitIntoWords(document);
+    const auto word_count = std::count_if(words.begin(), words.end(), [this](std::string_view word) {
+        return !IsStopWord(word);
+    });
+    
+    // Бюджет проверяется до изменения индекса: отклоненный док-т не оставляет следов
+    if (options_.memory_budget_bytes > 0) {
+        ReserveMemoryBudget(EstimateDocumentBytes(document, words, word_count));
+    }
 
     // Сохраняем ID док-та
     document_ids_.emplace(document_id);
     
-    auto words = SplitIntoWordsNoStop(document);
-    
-    // Создаем новую строку и инициализируем содержимым document
-    const std::string doc_content { document };
-    // Сохраняем док-т в системе
-    documents_.emplace(document_id, DocumentData{ doc_content, ComputeAverageRating(ratings), status });
+    // Сохраняем метаданные док-та в колонках под новым порядковым номером
+    const int ordinal = static_cast<int>(ordinal_ids_.size());
+    document_ordinals_.emplace(document_id, ordinal);
+    ordinal_ids_.push_back(document_id);
+    ratings_.push_back(ComputeAverageRating(ratings));
+    statuses_.push_back(status);
+    contents_.emplace_back(document);
+    for (Bitmap& bitmap : status_bitmaps_) {
+        bitmap.Resize(ordinal_ids_.size());
+    }
+    status_bitmaps_[static_cast<size_t>(status)].Set(ordinal);
     
-    words = SplitIntoWordsNoStop(documents_.at(document_id).content);
+    const double inv_word_count = 1.0 / word_count;
+    std::vector<uint32_t> term_ids;
+    term_ids.reserve(word_count);
+    for (uint32_t position = 0; position < words.size(); ++position) {
+        std::string_view word = words[position];
+        if (IsStopWord(word)) {
+            continue;
+        }
+        // Списки индексов хранятся по ID термина, новый термин получает пустые списки
+        const uint32_t term_id = vocabulary_.Insert(word);
+        if (term_id == term_postings_.size()) {
+            term_postings_.emplace_back();
+            if (options_.engine == RankingEngine::IMPACT_ORDERED) {
+                term_impacts_.emplace_back();
+            }
+        }
+        term_ids.push_back(term_id);
+        
+        if (options_.store_positions) {
+            term_postings_[term_id].Add(ordinal, inv_word_count, position, options_.max_positions_per_document);
+        } else {
+            term_postings_[term_id].Add(ordinal, inv_word_count);
+        }
+    }
     
-    const double inv_word_count = 1.0 / words.size();
-    for (std::string_view word : words) {
-        word_to_document_freqs_[word][document_id] += inv_word_count;
-        document_to_word_freqs_[document_id][word] += inv_word_count;
+    // TF каждого слова накапливается так же, как в списке вхождений, чтобы значения совпадали
+    std::sort(term_ids.begin(), term_ids.end());
+    std::vector<std::pair<std::string_view, double>> word_freqs;
+    for (size_t i = 0; i < term_ids.size();) {
+        const uint32_t term_id = term_ids[i];
+        double term_freq = 0.0;
+        for (; i < term_ids.size() && term_ids[i] == term_id; ++i) {
+            term_freq += inv_word_count;
+        }
+        word_freqs.emplace_back(vocabulary_.GetTerm(term_id), term_freq);
+        if constexpr (FORWARD_INDEX_ENABLED) {
+            forward_terms_.push_back(term_id);
+            forward_freqs_.push_back(term_freq);
+        }
+    }
+    if constexpr (FORWARD_INDEX_ENABLED) {
+        forward_offsets_.push_back(forward_terms_.size());
     }
+    UpdateImpactIndex(word_freqs, ordinal, true);
+    
+    GetStageMetrics().documents.Set(GetDocumentCount());
 }
 
 /*
@@ -50,16 +108,23 @@ void SearchServer::AddDocument(int document_id, std::string_view document,
 */
 
 void SearchServer::RemoveDocument(int document_id) {
-    if (documents_.count(document_id) == 0) {
+    METRIC_DURATION(GetStageMetrics().remove);
+    
+    if (document_ordinals_.count(document_id) == 0) {
         throw std::invalid_argument("Document ID does not exist"s);
     }
+    const int ordinal = document_ordinals_.at(document_id);
     
-    for (auto [word, _] : document_to_word_freqs_.at(document_id)) {
-        word_to_document_freqs_.at(word).erase(document_id);
+    const auto word_freqs = GetDocumentWords(ordinal);
+    for (auto [word, _] : word_freqs) {
+        term_postings_[*FindTermId(word)].Erase(ordinal);
     }
-    document_to_word_freqs_.erase(document_id);
+    EraseDocumentMetadata(document_id, ordinal);
+    UpdateImpactIndex(word_freqs, ordinal, false);
     document_ids_.erase(document_id);
-    documents_.erase(document_id);
+    CompactRemovedDocuments();
+    
+    GetStageMetrics().documents.Set(GetDocumentCount());
 }
 
 void SearchServer::RemoveDocument(const std::execution::sequenced_policy&, int document_id) {
@@ -67,32 +132,30 @@ void SearchServer::RemoveDocument(const std::execution::sequenced_policy&, int d
 }
 
 void SearchServer::RemoveDocument(const std::execution::parallel_policy&, int document_id) {
-    if (documents_.count(document_id) == 0) {
+    METRIC_DURATION(GetStageMetrics().remove);
+    
+    if (document_ordinals_.count(document_id) == 0) {
         throw std::invalid_argument("Document ID does not exist"s);
     }
+    const int ordinal = document_ordinals_.at(document_id);
     
-    // Создаем вектор указателей на слова в док-те
-    const auto& words_freqs = document_to_word_freqs_.at(document_id);
-    std::vector<const std::string*> words(words_freqs.size());
-    // Используем transform для извлечения указателей из словаря
-    std::transform(std::execution::par,
-                  words_freqs.begin(), words_freqs.end(),
-                  words.begin(),
-                  [](const auto& elem) {
-                      return new std::string(elem.first);;
-                  });
+    // Создаем вектор слов док-та
+    const auto word_freqs = GetDocumentWords(ordinal);
     
     // Удаляем док-т из словаря для каждого слова в док-те
     std::for_each(std::execution::par,
-                  words.begin(), words.end(),
-                 [this, document_id](const std::string* elem) {
-                     word_to_document_freqs_.at(*elem).erase(document_id);
+                  word_freqs.begin(), word_freqs.end(),
+                 [this, ordinal](const auto& word_freq) {
+                     term_postings_[*FindTermId(word_freq.first)].Erase(ordinal);
                  });
     
     // Удаляем док-т из остальных словарей
-    document_to_word_freqs_.erase(document_id);
+    EraseDocumentMetadata(document_id, ordinal);
+    UpdateImpactIndex(word_freqs, ordinal, false);
     document_ids_.erase(document_id);
-    documents_.erase(document_id);
+    CompactRemovedDocuments();
+    
+    GetStageMetrics().documents.Set(GetDocumentCount());
 }
 
 /*
@@ -107,6 +170,27 @@ std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query)
     return FindTopDocuments(std::execution::seq, raw_query, DocumentStatus::ACTUAL);
 }
 
+/*
+Реализация FindDocumentsAfter
+*/
+
+std::vector<Document> SearchServer::FindDocumentsAfter(std::string_view raw_query,
+                                                       const std::optional<Document>& after,
+                                                       size_t page_size) const {
+    return FindDocumentsAfter(std::execution::seq, raw_query, DocumentStatus::ACTUAL, after, page_size);
+}
+
+bool SearchServer::RanksBefore(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) >= accuracy) {
+        return lhs.relevance > rhs.relevance;
+    }
+    if (lhs.rating != rhs.rating) {
+        return lhs.rating > rhs.rating;
+    }
+    // ID делает порядок полным, иначе курсор мог бы пропустить документы с равными оценками
+    return lhs.id < rhs.id;
+}
+
 /*
 Реализация MatchDocument
 */
@@ -114,37 +198,32 @@ std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query)
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(
     std::string_view raw_query, int document_id) const
 {
+    METRIC_DURATION(GetStageMetrics().match);
+    TraceSpan trace_span("MatchDocument", true);
+    
     if (document_id < 0) {
         throw std::invalid_argument("Incorrect document ID"s);
     }
-    if (documents_.count(document_id) == 0) {
-        throw std::out_of_range("Document ID does not exist"s);
-    }
+    const int ordinal = GetOrdinal(document_id);
     
     const Query query = ParseQuery(raw_query);
-    const auto& word_freqs = document_to_word_freqs_.at(document_id);
 
+    // Минус-слова и обязательные слова проверяются первыми: отброшенный док-т не требует обхода плюс-слов
+    if (HasMinusWord(query, ordinal) || !HasRequiredWords(query, ordinal)
+        || !MatchesPhrases(query, ordinal)) {
+        return { std::vector<std::string_view>{}, statuses_[ordinal] };
+    }
+    
     std::vector<std::string_view> matched_words;
     matched_words.reserve(query.plus_words.size());
     
-    // Объявляем лямбда-функцию для проверки наличия слова в минус-словаре
-    auto minus_condition = [&word_freqs](const std::string_view word) {
-        return word_freqs.count(word) > 0;
-    };
-    
-    // Проверяем есть ли исключенные слова в док-те
-    if (std::none_of(query.minus_words.begin(), query.minus_words.end(), minus_condition)) {
-        // Если исключенных слов в док-те нет, перебираем слова поискового запроса
-        std::for_each(query.plus_words.begin(), query.plus_words.end(),
-                      // Захватываем все переменные по ссылке
-                      [&](const std::string_view word) {
-                          if (word_to_document_freqs_.count(word) != 0 && word_to_document_freqs_.at(word).count(document_id)) {
-                              matched_words.emplace_back(word);
-                          }
-                      });
+    for (std::string_view word : query.plus_words) {
+        if (DocumentHasWord(ordinal, word)) {
+            matched_words.emplace_back(word);
+        }
     }
     
-    return { matched_words, documents_.at(document_id).status };
+    return { matched_words, statuses_[ordinal] };
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(
@@ -156,49 +235,182 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(
     const std::execution::parallel_policy&, std::string_view raw_query, int document_id) const
 {
+    METRIC_DURATION(GetStageMetrics().match);
+    TraceSpan trace_span("MatchDocument", true);
+    
     if (document_id < 0) {
         throw std::invalid_argument("Incorrect document ID"s);
     }
-    if (documents_.count(document_id) == 0) {
-        throw std::out_of_range("Document ID does not exist"s);
-    }
+    const int ordinal = GetOrdinal(document_id);
 
     const Query& query = ParseQuery(raw_query, false);
-    const auto& word_freqs = document_to_word_freqs_.at(document_id);
+    
+    if (HasMinusWord(query, ordinal) || !HasRequiredWords(query, ordinal)
+        || !MatchesPhrases(query, ordinal)) {
+        return { std::vector<std::string_view>{}, statuses_[ordinal] };
+    }
     
     std::vector<std::string_view> matched_words;
     matched_words.reserve(query.plus_words.size());
     
-    auto minus_condition = [&word_freqs](const std::string_view word) {
-        return word_freqs.count(word) > 0;
-    };
-    
-    if (std::none_of(query.minus_words.begin(), query.minus_words.end(), minus_condition)) {
-        std::copy_if(query.plus_words.begin(), query.plus_words.end(),
-                     std::back_inserter(matched_words), [&word_freqs](const std::string_view word) {
-                         return word_freqs.count(word) > 0;
-                     });
-    }
+    std::copy_if(query.plus_words.begin(), query.plus_words.end(),
+                 std::back_inserter(matched_words), [this, ordinal](const std::string_view word) {
+                     return DocumentHasWord(ordinal, word);
+                 });
     
     std::sort(std::execution::par, matched_words.begin(), matched_words.end());
     auto it = std::unique(matched_words.begin(), matched_words.end());
     matched_words.erase(it, matched_words.end());
 
-    return { matched_words, documents_.at(document_id).status };
+    return { matched_words, statuses_[ordinal] };
+}
+
+MatchedDocuments SearchServer::MatchDocuments(std::string_view raw_query, const std::vector<int>& document_ids) const {
+    return MatchDocuments(std::execution::seq, raw_query, document_ids);
 }
 
 // Метод получения частот слов по ID документа
-const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    if (document_to_word_freqs_.count(document_id)) {
-        return document_to_word_freqs_.at(document_id);
-    } else { // Если док-та не существует, возвращаем ссылку на пустой контейнер
-        static const std::map<std::string_view, double> tmp;
-        return tmp;
+WordFrequencies SearchServer::GetWordFrequencies(int document_id) const {
+    const auto it = document_ordinals_.find(document_id);
+    // Если док-та не существует, возвращаем пустое представление
+    if (it == document_ordinals_.end()) {
+        return {};
+    }
+    if constexpr (!FORWARD_INDEX_ENABLED) {
+        // Слова документа находятся перебором списков вхождений и упорядочиваются по ID термина
+        std::vector<std::pair<uint32_t, double>> term_freqs;
+        for (const auto& [word, term_freq] : GetDocumentWords(it->second)) {
+            term_freqs.emplace_back(*vocabulary_.Find(word), term_freq);
+        }
+        std::sort(term_freqs.begin(), term_freqs.end());
+        std::vector<uint32_t> terms;
+        std::vector<double> freqs;
+        terms.reserve(term_freqs.size());
+        freqs.reserve(term_freqs.size());
+        for (const auto& [term_id, term_freq] : term_freqs) {
+            terms.push_back(term_id);
+            freqs.push_back(term_freq);
+        }
+        return WordFrequencies(vocabulary_.GetTerms().data(), std::move(terms), std::move(freqs));
     }
+    const size_t begin = forward_offsets_[it->second];
+    const size_t size = forward_offsets_[it->second + 1] - begin;
+    return WordFrequencies(vocabulary_.GetTerms().data(), { forward_terms_.data() + begin, size },
+                           { forward_freqs_.data() + begin, size });
+}
+
+std::optional<std::string_view> SearchServer::GetDocumentContent(int document_id) const {
+    const int ordinal = GetOrdinal(document_id);
+    // Тексты освобождаются по возрастанию порядкового номера
+    if (static_cast<size_t>(ordinal) < next_evicted_content_) {
+        return std::nullopt;
+    }
+    return contents_[ordinal];
+}
+
+const SearchServer::StageMetrics& SearchServer::GetStageMetrics() {
+    // Ссылки на метрики запрашиваются у реестра один раз, дальше обновляются напрямую
+    static const StageMetrics metrics = [] {
+        auto& registry = MetricsRegistry::Instance();
+        auto stage = [&registry](const std::string& name) -> MetricHistogram& {
+            return registry.GetHistogram("search_server_stage_duration_seconds"s,
+                                         "Duration of SearchServer processing stages"s,
+                                         "stage=\""s + name + "\""s, 1e-9);
+        };
+        
+        return StageMetrics{
+            stage("parse"s), stage("posting_scan"s), stage("minus_filter"s), stage("top_k"s),
+            stage("match"s), stage("ingest"s), stage("remove"s),
+            registry.GetCounter("search_server_queries_total"s, "Number of search queries (FindTopDocuments and FindDocumentsAfter calls)"s),
+            registry.GetGauge("search_server_documents"s, "Number of indexed documents"s),
+            registry.GetGauge("search_server_memory_bytes"s, "Estimated memory used by the index"s)
+        };
+    }();
+    
+    return metrics;
 }
 
 size_t SearchServer::GetDocumentCount() const {
-    return documents_.size();
+    return document_ordinals_.size();
+}
+
+MemoryReport SearchServer::GetMemoryReport(size_t top_posting_lists) const {
+    MemoryReport report;
+    auto add_usage = [&report](std::string name, MemoryUsage usage) {
+        usage.name = std::move(name);
+        report.structures.push_back(std::move(usage));
+    };
+    
+    MemoryUsage stop_words = GetTreeMemoryUsage(stop_words_);
+    for (const std::string& word : stop_words_) {
+        stop_words += GetStringHeapUsage(word);
+    }
+    add_usage("stop_words"s, stop_words);
+    
+    add_usage("vocabulary"s, vocabulary_.GetMemoryUsage());
+    
+    // Самые большие списки отбираются кучей из top_posting_lists элементов с наименьшим наверху
+    auto& largest = report.largest_posting_lists;
+    auto is_larger = [](const auto& lhs, const auto& rhs) {
+        return lhs.second > rhs.second;
+    };
+    MemoryUsage posting_lists = GetVectorMemoryUsage(term_postings_);
+    posting_lists.objects = 0;
+    for (uint32_t term_id = 0; term_id < term_postings_.size(); ++term_id) {
+        const MemoryUsage usage = term_postings_[term_id].GetMemoryUsage();
+        posting_lists += usage;
+        if (top_posting_lists == 0) {
+            continue;
+        }
+        if (largest.size() < top_posting_lists) {
+            largest.emplace_back(vocabulary_.GetTerm(term_id), usage.Total());
+            std::push_heap(largest.begin(), largest.end(), is_larger);
+        } else if (usage.Total() > largest.front().second) {
+            std::pop_heap(largest.begin(), largest.end(), is_larger);
+            largest.back() = { vocabulary_.GetTerm(term_id), usage.Total() };
+            std::push_heap(largest.begin(), largest.end(), is_larger);
+        }
+    }
+    std::sort_heap(largest.begin(), largest.end(), is_larger);
+    add_usage("posting_lists"s, posting_lists);
+    
+    MemoryUsage impact_lists = GetVectorMemoryUsage(term_impacts_);
+    impact_lists.objects = 0;
+    for (const ImpactList& impacts : term_impacts_) {
+        impact_lists += impacts.GetMemoryUsage();
+    }
+    add_usage("impact_lists"s, impact_lists);
+    
+    MemoryUsage forward_index = GetVectorMemoryUsage(forward_terms_);
+    forward_index += GetVectorMemoryUsage(forward_freqs_);
+    forward_index += GetVectorMemoryUsage(forward_offsets_);
+    forward_index.objects = forward_terms_.size();
+    add_usage("forward_index"s, forward_index);
+    
+    MemoryUsage documents = GetTreeMemoryUsage(document_ids_);
+    documents += GetTreeMemoryUsage(document_ordinals_);
+    documents.objects = GetDocumentCount();
+    add_usage("documents"s, documents);
+    
+    MemoryUsage columns = GetVectorMemoryUsage(ordinal_ids_);
+    columns += GetVectorMemoryUsage(ratings_);
+    columns += GetVectorMemoryUsage(statuses_);
+    for (const Bitmap& bitmap : status_bitmaps_) {
+        columns += bitmap.GetMemoryUsage();
+    }
+    columns.objects = ordinal_ids_.size();
+    add_usage("document_columns"s, columns);
+    
+    MemoryUsage contents = GetVectorMemoryUsage(contents_);
+    contents.objects = 0;
+    for (const std::string& content : contents_) {
+        contents += GetStringHeapUsage(content);
+        contents.objects += content.empty() ? 0 : 1;
+    }
+    add_usage("contents"s, contents);
+    
+    GetStageMetrics().memory.Set(static_cast<double>(report.TotalBytes()));
+    return report;
 }
 
 bool SearchServer::IsStopWord(std::string_view word) const {
@@ -211,16 +423,6 @@ bool SearchServer::IsValidWord(std::string_view word) {
     });
 }
 
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(std::string_view text) const {
-    std::vector<std::string_view> words;
-    for (std::string_view word : SplitIntoWords(text)) {
-        if (!IsStopWord(word)) {
-            words.push_back(word);
-        }
-    }
-    return words;
-}
-
 int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
     if (ratings.empty()) {
         return 0;
@@ -231,8 +433,435 @@ int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
     return rating_sum / static_cast<int>(ratings.size());
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(std::string_view word) const {
-    return std::log(documents_.size() * 1.0 / word_to_document_freqs_.at(word).size());
+double SearchServer::ComputeInverseDocumentFreq(const PostingList& posting_list) const {
+    return std::log(GetDocumentCount() * 1.0 / posting_list.Size());
+}
+
+const PostingList* SearchServer::FindPostingList(std::string_view word) const {
+    const auto term_id = FindTermId(word);
+    return term_id ? &term_postings_[*term_id] : nullptr;
+}
+
+int SearchServer::GetOrdinal(int document_id) const {
+    const auto it = document_ordinals_.find(document_id);
+    if (it == document_ordinals_.end()) {
+        throw std::out_of_range("Document ID does not exist"s);
+    }
+    return it->second;
+}
+
+Bitmap SearchServer::BuildExclusionBitmap(const Query& query) const {
+    Bitmap excluded;
+    // Пустая карта ничего не исключает, и без минус-слов память под нее не выделяется
+    if (query.minus_words.empty()) {
+        return excluded;
+    }
+    
+    excluded.Resize(ordinal_ids_.size());
+    for (std::string_view word : query.minus_words) {
+        const PostingList* posting_list = FindPostingList(word);
+        if (posting_list == nullptr) {
+            continue;
+        }
+        for (const auto [ordinal, _] : *posting_list) {
+            excluded.Set(ordinal);
+        }
+    }
+    
+    return excluded;
+}
+
+bool SearchServer::HasMinusWord(const Query& query, int ordinal) const {
+    return std::any_of(query.minus_words.begin(), query.minus_words.end(),
+                       [this, ordinal](std::string_view word) {
+                           return DocumentHasWord(ordinal, word);
+                       });
+}
+
+bool SearchServer::HasRequiredWords(const Query& query, int ordinal) const {
+    auto has_word = [this, ordinal](std::string_view word) {
+        return DocumentHasWord(ordinal, word);
+    };
+    return std::all_of(query.required_words.begin(), query.required_words.end(), has_word)
+        && std::all_of(query.required_expansions.begin(), query.required_expansions.end(),
+                       [&has_word](const std::vector<std::string_view>& expansion) {
+                           return std::any_of(expansion.begin(), expansion.end(), has_word);
+                       });
+}
+
+bool SearchServer::MatchesPhrases(const Query& query, int ordinal) const {
+    std::vector<int> starts;
+    std::vector<int> positions;
+    for (const auto& phrase : query.phrases) {
+        for (size_t i = 0; i < phrase.size(); ++i) {
+            const auto [word, offset] = phrase[i];
+            const PostingList* posting_list = FindPostingList(word);
+            if (posting_list == nullptr) {
+                return false;
+            }
+            const size_t index = posting_list->Find(ordinal);
+            if (index == PostingList::NPOS) {
+                return false;
+            }
+            
+            posting_list->GetPositions(index, positions);
+            for (int& position : positions) {
+                position -= offset;
+            }
+            if (i == 0) {
+                starts.swap(positions);
+            } else {
+                starts.resize(IntersectSorted(starts.data(), starts.size(),
+                                              positions.data(), positions.size(), starts.data()));
+            }
+            if (starts.empty()) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+std::vector<const PostingList*> SearchServer::GetProximityLists(const Query& query) const {
+    std::vector<const PostingList*> posting_lists;
+    if (options_.proximity_weight <= 0 || query.plus_words.size() < 2) {
+        return posting_lists;
+    }
+    for (std::string_view word : query.plus_words) {
+        if (const PostingList* posting_list = FindPostingList(word)) {
+            posting_lists.push_back(posting_list);
+        }
+    }
+    return posting_lists;
+}
+
+double SearchServer::ComputeProximityBoost(const std::vector<const PostingList*>& posting_lists, int ordinal) const {
+    if (posting_lists.size() < 2) {
+        return 0.0;
+    }
+    
+    // Позиции слов запроса, встречающихся в документе
+    std::vector<std::vector<int>> word_positions;
+    for (const PostingList* posting_list : posting_lists) {
+        const size_t index = posting_list->Find(ordinal);
+        if (index != PostingList::NPOS) {
+            posting_list->GetPositions(index, word_positions.emplace_back());
+        }
+    }
+    if (word_positions.size() < 2) {
+        return 0.0;
+    }
+    
+    // Минимальное окно, содержащее хотя бы одну позицию каждого слова: на каждом шаге
+    // сдвигается слово с наименьшей текущей позицией
+    std::vector<size_t> cursors(word_positions.size(), 0);
+    int min_span = std::numeric_limits<int>::max();
+    while (true) {
+        size_t min_word = 0;
+        int min_position = std::numeric_limits<int>::max();
+        int max_position = std::numeric_limits<int>::min();
+        for (size_t i = 0; i < word_positions.size(); ++i) {
+            const int position = word_positions[i][cursors[i]];
+            if (position < min_position) {
+                min_position = position;
+                min_word = i;
+            }
+            max_position = std::max(max_position, position);
+        }
+        min_span = std::min(min_span, max_position - min_position);
+        if (++cursors[min_word] == word_positions[min_word].size()) {
+            break;
+        }
+    }
+    
+    return options_.proximity_weight * (word_positions.size() - 1) / std::max(min_span, 1);
+}
+
+void SearchServer::UpdateImpactIndex(const std::vector<std::pair<std::string_view, double>>& word_freqs,
+                                     int ordinal, bool is_added) {
+    if (options_.engine != RankingEngine::IMPACT_ORDERED) {
+        return;
+    }
+    
+    const size_t document_count = GetDocumentCount();
+    for (const auto& [word, term_freq] : word_freqs) {
+        const uint32_t term_id = *FindTermId(word);
+        ImpactList& impacts = term_impacts_[term_id];
+        if (!impacts.HasPendingChanges()) {
+            pending_impact_terms_.push_back(term_id);
+        }
+        if (is_added) {
+            impacts.Insert(ordinal, QuantizeImpact(term_freq));
+        } else {
+            impacts.Erase(ordinal, QuantizeImpact(term_freq));
+        }
+        impacts.RefreshIdf(document_count);
+    }
+    impact_lists_pending_.store(!pending_impact_terms_.empty(), std::memory_order_release);
+    
+    // IDF остальных слов зависит только от числа документов и пересчитывается при заметном его изменении
+    const double drift = std::abs(static_cast<double>(document_count) - static_cast<double>(idf_document_count_));
+    if (drift > options_.idf_refresh_drift * idf_document_count_) {
+        for (ImpactList& impacts : term_impacts_) {
+            impacts.RefreshIdf(document_count);
+        }
+        idf_document_count_ = document_count;
+    }
+}
+
+void SearchServer::FlushImpactIndex() const {
+    if (!impact_lists_pending_.load(std::memory_order_acquire)) {
+        return;
+    }
+    std::lock_guard guard(impact_flush_mutex_);
+    if (!impact_lists_pending_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    for (const uint32_t term_id : pending_impact_terms_) {
+        term_impacts_[term_id].Flush();
+    }
+    pending_impact_terms_.clear();
+    impact_lists_pending_.store(false, std::memory_order_release);
+}
+
+bool SearchServer::UsesImpactEngine(const Query& query) const {
+    return options_.engine == RankingEngine::IMPACT_ORDERED && !query.IsConjunctive()
+        && options_.proximity_weight <= 0;
+}
+
+void SearchServer::EraseDocumentMetadata(int document_id, int ordinal) {
+    // Строка колонок остается за удаленным документом, но он исключается из всех битовых карт
+    for (Bitmap& bitmap : status_bitmaps_) {
+        bitmap.Reset(ordinal);
+    }
+    std::string().swap(contents_[ordinal]);
+    document_ordinals_.erase(document_id);
+    ++removed_ordinals_;
+    memory_estimate_stale_ = true;
+    
+    if constexpr (FORWARD_INDEX_ENABLED) {
+        forward_garbage_ += forward_offsets_[ordinal + 1] - forward_offsets_[ordinal];
+    }
+}
+
+size_t SearchServer::EstimateDocumentBytes(std::string_view document, const std::vector<std::string_view>& words,
+                                           size_t word_count) const {
+    // Каждое значимое слово добавляет вхождение в список и, если они включены, запись прямого
+    // индекса, позицию и вклад. Повторы слова считаются отдельно - оценка с запасом
+    size_t word_bytes = sizeof(int) + sizeof(double);
+    if (FORWARD_INDEX_ENABLED) {
+        word_bytes += sizeof(uint32_t) + sizeof(double);
+    }
+    if (options_.store_positions) {
+        word_bytes += 2;
+    }
+    if (options_.engine == RankingEngine::IMPACT_ORDERED) {
+        word_bytes += sizeof(int) + sizeof(uint8_t);
+    }
+    
+    const size_t content_bytes = sizeof(std::string) + document.size() + 1 + ALLOCATION_OVERHEAD;
+    const size_t metadata_bytes = 2 * (TREE_NODE_OVERHEAD + ALLOCATION_OVERHEAD) + sizeof(int)
+        + sizeof(std::pair<const int, int>) + 2 * sizeof(int) + sizeof(DocumentStatus) + sizeof(size_t);
+    
+    // Вектор, которому не хватит емкости, за одну вставку удвоит свой блок: колонки, битовые карты,
+    // пул прямого индекса и списки вхождений слов документа
+    const size_t ordinal_count = ordinal_ids_.size() + 1;
+    size_t vector_growth = GetVectorGrowthBytes(ordinal_ids_, 1) + GetVectorGrowthBytes(ratings_, 1)
+        + GetVectorGrowthBytes(statuses_, 1) + GetVectorGrowthBytes(contents_, 1);
+    for (const Bitmap& bitmap : status_bitmaps_) {
+        vector_growth += bitmap.GetGrowthBytes(ordinal_count);
+    }
+    if (FORWARD_INDEX_ENABLED) {
+        vector_growth += GetVectorGrowthBytes(forward_terms_, word_count)
+            + GetVectorGrowthBytes(forward_freqs_, word_count) + GetVectorGrowthBytes(forward_offsets_, 1);
+    }
+    // Новое слово добавляет термин словаря, ячейки списков по его ID и первые блоки этих списков;
+    // векторы ячеек растут вместе со словарем
+    const bool impact_ordered = options_.engine == RankingEngine::IMPACT_ORDERED;
+    const size_t new_lists_bytes = sizeof(PostingList) + 2 * ALLOCATION_OVERHEAD
+        + (impact_ordered ? sizeof(ImpactList) + 2 * ALLOCATION_OVERHEAD : 0);
+    size_t new_word_count = 0;
+    for (std::string_view word : words) {
+        if (IsStopWord(word)) {
+            continue;
+        }
+        if (const PostingList* posting_list = FindPostingList(word)) {
+            vector_growth += posting_list->GetGrowthBytes(2);
+        } else {
+            vector_growth += new_lists_bytes + TermDictionary::EstimateTermBytes(word);
+            ++new_word_count;
+        }
+    }
+    vector_growth += GetVectorGrowthBytes(term_postings_, new_word_count);
+    if (impact_ordered) {
+        vector_growth += GetVectorGrowthBytes(term_impacts_, new_word_count);
+    }
+    return word_count * word_bytes + content_bytes + metadata_bytes + vector_growth;
+}
+
+void SearchServer::ReserveMemoryBudget(size_t document_bytes) {
+    const size_t budget = options_.memory_budget_bytes;
+    if ((memory_estimate_ + document_bytes > budget && memory_estimate_stale_)
+        || memory_unmeasured_bytes_ > budget / 8) {
+        memory_estimate_ = GetMemoryReport(0).TotalBytes();
+        memory_estimate_stale_ = false;
+        memory_unmeasured_bytes_ = 0;
+    }
+    
+    if (options_.memory_budget_policy == MemoryBudgetPolicy::EVICT_CONTENT) {
+        // Тексты освобождаются по возрастанию порядкового номера, т.е. от самых старых документов
+        while (memory_estimate_ + document_bytes > budget && next_evicted_content_ < contents_.size()) {
+            std::string& content = contents_[next_evicted_content_++];
+            const size_t freed = GetStringHeapUsage(content).Total();
+            std::string().swap(content);
+            memory_estimate_ -= std::min(memory_estimate_, freed);
+        }
+    }
+    
+    if (memory_estimate_ + document_bytes > budget) {
+        throw std::runtime_error("Memory budget exceeded"s);
+    }
+    memory_estimate_ += document_bytes;
+    memory_unmeasured_bytes_ += document_bytes;
+    memory_estimate_stale_ = true;
+}
+
+bool SearchServer::IsLiveOrdinal(int ordinal) const {
+    return std::any_of(status_bitmaps_.begin(), status_bitmaps_.end(), [ordinal](const Bitmap& bitmap) {
+        return bitmap.Test(ordinal);
+    });
+}
+
+void SearchServer::CompactForwardIndex() {
+    // Слова живых документов сдвигаются к началу пула, удаленные получают пустые участки
+    size_t size = 0;
+    size_t begin = forward_offsets_[0];
+    for (size_t ordinal = 0; ordinal + 1 < forward_offsets_.size(); ++ordinal) {
+        const size_t end = forward_offsets_[ordinal + 1];
+        if (IsLiveOrdinal(static_cast<int>(ordinal))) {
+            for (size_t i = begin; i < end; ++i, ++size) {
+                forward_terms_[size] = forward_terms_[i];
+                forward_freqs_[size] = forward_freqs_[i];
+            }
+        }
+        begin = end;
+        forward_offsets_[ordinal + 1] = size;
+    }
+    forward_terms_.resize(size);
+    forward_terms_.shrink_to_fit();
+    forward_freqs_.resize(size);
+    forward_freqs_.shrink_to_fit();
+    forward_garbage_ = 0;
+}
+
+void SearchServer::CompactRemovedDocuments() {
+    if (removed_ordinals_ >= MIN_COMPACTED_ORDINALS && removed_ordinals_ * 2 > ordinal_ids_.size()) {
+        CompactOrdinals();
+    } else if (FORWARD_INDEX_ENABLED && forward_garbage_ * 2 > forward_terms_.size()) {
+        CompactForwardIndex();
+    }
+}
+
+void SearchServer::CompactOrdinals() {
+    // После уплотнения пула участки удаленных документов пусты, и границы живых
+    // можно сдвигать вместе с остальными колонками
+    if constexpr (FORWARD_INDEX_ENABLED) {
+        CompactForwardIndex();
+    }
+    
+    std::vector<int> new_ordinals(ordinal_ids_.size(), -1);
+    int ordinal_count = 0;
+    size_t evicted_count = 0;
+    for (size_t ordinal = 0; ordinal < ordinal_ids_.size(); ++ordinal) {
+        if (!IsLiveOrdinal(static_cast<int>(ordinal))) {
+            continue;
+        }
+        const int new_ordinal = ordinal_count++;
+        new_ordinals[ordinal] = new_ordinal;
+        evicted_count += ordinal < next_evicted_content_ ? 1 : 0;
+        if (static_cast<size_t>(new_ordinal) != ordinal) {
+            ordinal_ids_[new_ordinal] = ordinal_ids_[ordinal];
+            ratings_[new_ordinal] = ratings_[ordinal];
+            statuses_[new_ordinal] = statuses_[ordinal];
+            contents_[new_ordinal] = std::move(contents_[ordinal]);
+            if constexpr (FORWARD_INDEX_ENABLED) {
+                forward_offsets_[new_ordinal + 1] = forward_offsets_[ordinal + 1];
+            }
+        }
+        document_ordinals_.at(ordinal_ids_[new_ordinal]) = new_ordinal;
+    }
+    
+    auto truncate = [ordinal_count](auto& values) {
+        values.resize(ordinal_count);
+        values.shrink_to_fit();
+    };
+    truncate(ordinal_ids_);
+    truncate(ratings_);
+    truncate(statuses_);
+    truncate(contents_);
+    if constexpr (FORWARD_INDEX_ENABLED) {
+        forward_offsets_.resize(ordinal_count + 1);
+        forward_offsets_.shrink_to_fit();
+    }
+    for (size_t status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+        Bitmap bitmap;
+        bitmap.Resize(ordinal_count);
+        for (int ordinal = 0; ordinal < ordinal_count; ++ordinal) {
+            if (static_cast<size_t>(statuses_[ordinal]) == status) {
+                bitmap.Set(ordinal);
+            }
+        }
+        status_bitmaps_[status] = std::move(bitmap);
+    }
+    
+    for (PostingList& posting_list : term_postings_) {
+        posting_list.Renumber(new_ordinals);
+    }
+    for (ImpactList& impacts : term_impacts_) {
+        impacts.Renumber(new_ordinals);
+    }
+    pending_impact_terms_.clear();
+    impact_lists_pending_.store(false, std::memory_order_release);
+    
+    next_evicted_content_ = evicted_count;
+    removed_ordinals_ = 0;
+    memory_estimate_stale_ = true;
+}
+
+std::optional<uint32_t> SearchServer::FindTermId(std::string_view word) const {
+    return vocabulary_.Find(word);
+}
+
+bool SearchServer::DocumentHasTerm(int ordinal, uint32_t term_id) const {
+    if constexpr (FORWARD_INDEX_ENABLED) {
+        const auto begin = forward_terms_.begin() + forward_offsets_[ordinal];
+        const auto end = forward_terms_.begin() + forward_offsets_[ordinal + 1];
+        return std::binary_search(begin, end, term_id);
+    } else {
+        return term_postings_[term_id].Contains(ordinal);
+    }
+}
+
+bool SearchServer::DocumentHasWord(int ordinal, std::string_view word) const {
+    const auto term_id = FindTermId(word);
+    return term_id && DocumentHasTerm(ordinal, *term_id);
+}
+
+std::vector<std::pair<std::string_view, double>> SearchServer::GetDocumentWords(int ordinal) const {
+    std::vector<std::pair<std::string_view, double>> word_freqs;
+    if constexpr (FORWARD_INDEX_ENABLED) {
+        for (size_t i = forward_offsets_[ordinal]; i < forward_offsets_[ordinal + 1]; ++i) {
+            word_freqs.emplace_back(vocabulary_.GetTerm(forward_terms_[i]), forward_freqs_[i]);
+        }
+    } else {
+        for (uint32_t term_id = 0; term_id < term_postings_.size(); ++term_id) {
+            const size_t index = term_postings_[term_id].Find(ordinal);
+            if (index != PostingList::NPOS) {
+                word_freqs.emplace_back(vocabulary_.GetTerm(term_id), term_postings_[term_id].GetTermFreq(index));
+            }
+        }
+    }
+    return word_freqs;
 }
 
 SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) const {
@@ -241,30 +870,105 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) cons
     }
     
     bool is_minus = false;
+    bool is_required = false;
     if (text[0] == '-') {
         is_minus = true;
         text = text.substr(1);
+    } else if (text[0] == '+') {
+        // Обязательное слово: документ должен его содержать
+        is_required = true;
+        text = text.substr(1);
     }
-    // Дополнительная проверка на пустое исключенное слово / двойное тире / спец.символы
-    if (text.empty() || text[0] == '-' || !IsValidWord(text)) {
+    // Префиксное слово: звездочка в конце (одиночная звездочка остается обычным словом)
+    bool is_prefix = false;
+    if (text.size() > 1 && text.back() == '*') {
+        is_prefix = true;
+        text.remove_suffix(1);
+    }
+    // Дополнительная проверка на пустое исключенное или обязательное слово / двойной оператор / спец.символы
+    if (text.empty() || text[0] == '-' || text[0] == '+' || !IsValidWord(text)) {
         throw std::invalid_argument("Query word "s + std::string(text) + " is invalid"s);
     }
 
-    return { text, is_minus, IsStopWord(text) };
+    // Префикс стоп-слова может раскрыться в значимые слова, поэтому не отбрасывается
+    return { text, is_minus, is_required, !is_prefix && IsStopWord(text), is_prefix };
 }
 
 SearchServer::Query SearchServer::ParseQuery(std::string_view raw_query, bool policy_flag) const {
     Query query;
+    // Открытая фраза и смещение следующего слова в ней
+    std::optional<std::vector<std::pair<std::string_view, int>>> phrase;
+    int phrase_offset = 0;
+    
     for (auto word : SplitIntoWords(raw_query)) {
+        // Без позиций кавычка не открывает фразу и остается частью слова
+        if (options_.store_positions && !phrase && !word.empty() && word[0] == '"') {
+            phrase.emplace();
+            phrase_offset = 0;
+            word.remove_prefix(1);
+        }
+        
+        if (phrase) {
+            const bool is_last = !word.empty() && word.back() == '"';
+            if (is_last) {
+                word.remove_suffix(1);
+            }
+            const QueryWord query_word = ParseQueryWord(word);
+            if (query_word.is_minus || query_word.is_required || query_word.is_prefix) {
+                throw std::invalid_argument("Phrase word "s + std::string(word) + " is invalid"s);
+            }
+            if (!query_word.is_stop) {
+                phrase->emplace_back(query_word.data, phrase_offset);
+                query.plus_words.emplace_back(query_word.data);
+                query.required_words.emplace_back(query_word.data);
+            }
+            ++phrase_offset;
+            
+            if (is_last) {
+                // Фраза из одного значимого слова сводится к обязательному слову
+                if (phrase->size() > 1) {
+                    query.phrases.push_back(std::move(*phrase));
+                }
+                phrase.reset();
+            }
+            continue;
+        }
+        
         const QueryWord query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
+        if (query_word.is_prefix) {
+            // Ограничение числа слов действует только на ранжирование: минус- и обязательный
+            // префиксы раскрываются полностью, иначе от ограничения зависел бы состав результатов
+            const size_t limit = query_word.is_minus || query_word.is_required ? 0 : options_.max_prefix_expansions;
+            bool truncated = false;
+            auto expansion = ExpandPrefix(query_word.data, limit, truncated);
+            if (query_word.is_minus) {
+                query.minus_words.insert(query.minus_words.end(), expansion.begin(), expansion.end());
+            } else {
+                size_t scored = expansion.size();
+                if (options_.max_prefix_expansions > 0 && scored > options_.max_prefix_expansions) {
+                    scored = options_.max_prefix_expansions;
+                    truncated = true;
+                }
+                query.plus_words.insert(query.plus_words.end(), expansion.begin(), expansion.begin() + scored);
+                if (query_word.is_required) {
+                    query.required_expansions.push_back(std::move(expansion));
+                }
+            }
+            query.truncated_prefixes += truncated ? 1 : 0;
+        } else if (!query_word.is_stop) {
             if (query_word.is_minus) {
                 query.minus_words.emplace_back(query_word.data);
             } else {
                 query.plus_words.emplace_back(query_word.data);
+                if (query_word.is_required) {
+                    query.required_words.emplace_back(query_word.data);
+                }
             }
         }
     }
+    if (phrase) {
+        throw std::invalid_argument("Phrase is not closed"s);
+    }
     
     // Сортировка и удаление дубликатов будет работать только для однопоточных версий
     if (policy_flag) {
@@ -273,7 +977,29 @@ SearchServer::Query SearchServer::ParseQuery(std::string_view raw_query, bool po
         
         sort(query.plus_words.begin(), query.plus_words.end());
         query.plus_words.erase(unique(query.plus_words.begin(), query.plus_words.end()), query.plus_words.end());
+        
+        sort(query.required_words.begin(), query.required_words.end());
+        query.required_words.erase(unique(query.required_words.begin(), query.required_words.end()), query.required_words.end());
     }
     
     return query;
+}
+
+std::vector<std::string_view> SearchServer::ExpandPrefix(std::string_view prefix, size_t limit,
+                                                        bool& truncated) const {
+    std::vector<std::string_view> expansion;
+    truncated = false;
+    vocabulary_.ForEachWithPrefix(prefix, [&](uint32_t term_id) {
+        // Термины удаленных документов остаются в словаре с пустыми списками вхождений
+        if (term_postings_[term_id].Empty()) {
+            return true;
+        }
+        if (limit > 0 && expansion.size() == limit) {
+            truncated = true;
+            return false;
+        }
+        expansion.push_back(vocabulary_.GetTerm(term_id));
+        return true;
+    });
+    return expansion;
 }
\ No newline at end of file
@@ -1,23 +1,197 @@
 #pragma once
 
 #include "document.h"
+#include "array_view.h"
+#include "bitmap.h"
+#include "posting_list.h"
+#include "impact_list.h"
+#include "memory_usage.h"
+#include "term_dictionary.h"
 #include "string_processing.h"
 #include "concurrent_map.h"
+#include "metrics.h"
+#include "trace.h"
 
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
 #include <string>
 #include <string_view>
 #include <set>
+#include <type_traits>
 #include <vector>
 #include <tuple>
+#include <unordered_map>
 #include <map>
+#include <memory>
 #include <algorithm>
 #include <stdexcept>
 #include <execution>
+#include <optional>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 using std::literals::string_literals::operator""s;
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 constexpr double accuracy = 1e-6;
+// Порядковые номера перенумеровываются, когда удаленных документов не меньше этого числа
+// и они занимают больше половины колонок
+constexpr size_t MIN_COMPACTED_ORDINALS = 64;
+
+// Способ поиска лучших документов
+enum class RankingEngine {
+    // Полный подсчет релевантности всех найденных документов
+    EXACT,
+    // Обход вхождений по убыванию вклада с досрочной остановкой, когда состав топа уже
+    // не может измениться; попавшие в топ документы пересчитываются точно
+    IMPACT_ORDERED
+};
+
+// Действие при превышении бюджета памяти
+enum class MemoryBudgetPolicy {
+    // AddDocument отклоняется исключением
+    REJECT,
+    // Сначала освобождаются тексты самых старых документов, затем документ отклоняется
+    EVICT_CONTENT
+};
+
+/*
+Настройки индекса.
+Позиции слов нужны для фразовых запросов ("пушистый кот") и бонуса за близость слов;
+без них индекс хранит только TF, а кавычки в запросе остаются частью слова
+*/
+
+struct IndexOptions {
+    bool store_positions = false;
+    // Сколько позиций слова хранить для одного документа (0 - все). Ограничение экономит память
+    // на длинных документах, но фраза после последней сохраненной позиции не будет найдена
+    size_t max_positions_per_document = 0;
+    // Вес бонуса за близость слов запроса в документе (0 - без бонуса, требует позиций).
+    // Бонус равен weight * (k - 1) / span, где span - ширина минимального окна с k словами запроса
+    double proximity_weight = 0.0;
+    // Для IMPACT_ORDERED строится дополнительный индекс, упорядоченный по вкладам слов
+    RankingEngine engine = RankingEngine::EXACT;
+    // IDF в индексе вкладов кешируется: у слов добавленного/удаленного документа он обновляется сразу,
+    // у остальных - когда число документов изменится больше чем на эту долю
+    double idf_refresh_drift = 0.01;
+    // Бюджет памяти индекса в байтах (0 - без ограничения). Проверяется в AddDocument
+    // по оценке GetMemoryReport, дополненной приблизительным объемом добавляемого документа
+    size_t memory_budget_bytes = 0;
+    MemoryBudgetPolicy memory_budget_policy = MemoryBudgetPolicy::REJECT;
+    // Сколько слов индекса может дать префиксное слово запроса для ранжирования (0 - без ограничения).
+    // Берутся первые по алфавиту слова с префиксом; минус- и обязательные префиксы отбирают
+    // документы по всем своим словам. Число усеченных префиксов - счетчик truncated_prefixes в трассировке
+    size_t max_prefix_expansions = 64;
+};
+
+// Сборку без прямого индекса (для реплик только на чтение) можно получить, определив
+// SEARCH_SERVER_NO_FORWARD_INDEX. Такая сборка экономит память, но удаляет документы
+// и собирает GetWordFrequencies перебором всех списков вхождений
+#ifdef SEARCH_SERVER_NO_FORWARD_INDEX
+constexpr bool FORWARD_INDEX_ENABLED = false;
+#else
+constexpr bool FORWARD_INDEX_ENABLED = true;
+#endif
+
+/*
+Частоты слов документа - представление над прямым индексом SearchServer.
+Слова перечисляются в порядке их ID в словаре сервера.
+Действительно до следующего изменения сервера.
+Без прямого индекса частоты собираются из списков вхождений в собственный буфер представления
+*/
+
+class WordFrequencies {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<std::string_view, double>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+        
+        Iterator(const WordFrequencies* frequencies, size_t index) : frequencies_(frequencies), index_(index) {}
+        
+        value_type operator*() const {
+            return { frequencies_->term_words_[frequencies_->terms_[index_]], frequencies_->freqs_[index_] };
+        }
+        
+        Iterator& operator++() {
+            ++index_;
+            return *this;
+        }
+        
+        bool operator==(const Iterator& other) const {
+            return index_ == other.index_;
+        }
+        bool operator!=(const Iterator& other) const {
+            return !(*this == other);
+        }
+        
+    private:
+        const WordFrequencies* frequencies_;
+        size_t index_;
+    };
+    
+    WordFrequencies() = default;
+    
+    WordFrequencies(const std::string_view* term_words, ArrayView<uint32_t> terms, ArrayView<double> freqs)
+        : term_words_(term_words), terms_(terms), freqs_(freqs) {}
+    
+    // Представление над собственной копией частот; копии представления разделяют буфер
+    WordFrequencies(const std::string_view* term_words, std::vector<uint32_t> terms, std::vector<double> freqs)
+        : term_words_(term_words)
+        , storage_(std::make_shared<const Storage>(Storage{ std::move(terms), std::move(freqs) }))
+        , terms_(storage_->terms.data(), storage_->terms.size())
+        , freqs_(storage_->freqs.data(), storage_->freqs.size()) {}
+    
+    size_t size() const {
+        return terms_.size();
+    }
+    bool empty() const {
+        return terms_.empty();
+    }
+    
+    Iterator begin() const {
+        return Iterator(this, 0);
+    }
+    Iterator end() const {
+        return Iterator(this, terms_.size());
+    }
+    
+private:
+    struct Storage {
+        std::vector<uint32_t> terms;
+        std::vector<double> freqs;
+    };
+    
+    const std::string_view* term_words_ = nullptr;
+    std::shared_ptr<const Storage> storage_;
+    ArrayView<uint32_t> terms_;
+    ArrayView<double> freqs_;
+};
+
+/*
+Результат пакетного MatchDocuments: совпавшие слова всех документов лежат в одном массиве,
+слова i-го документа занимают [offsets[i], offsets[i + 1])
+*/
+
+struct MatchedDocuments {
+    std::vector<std::string_view> words;
+    std::vector<size_t> offsets;
+    std::vector<DocumentStatus> statuses;
+    
+    size_t size() const {
+        return statuses.size();
+    }
+    
+    ArrayView<std::string_view> GetWords(size_t index) const {
+        return { words.data() + offsets[index], offsets[index + 1] - offsets[index] };
+    }
+};
 
 class SearchServer {
 public:
@@ -26,15 +200,21 @@ public:
     */
     
     template <typename StringContainer>
-    explicit SearchServer(const StringContainer& stop_words) : stop_words_(MakeUniqueNonEmptyStrings(stop_words)) {
+    explicit SearchServer(const StringContainer& stop_words, const IndexOptions& options = {})
+        : stop_words_(MakeUniqueNonEmptyStrings(stop_words)), options_(options) {
         if (!all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
             throw std::invalid_argument("Some of stop words are invalid"s);
         }
+        if (options_.proximity_weight > 0 && !options_.store_positions) {
+            throw std::invalid_argument("Proximity scoring requires word positions"s);
+        }
     }
 
-    explicit SearchServer(const std::string& stop_words_text) : SearchServer(SplitIntoWords(stop_words_text)) {}
+    explicit SearchServer(const std::string& stop_words_text, const IndexOptions& options = {})
+        : SearchServer(SplitIntoWords(stop_words_text), options) {}
     
-    explicit SearchServer(std::string_view stop_words_text) : SearchServer(SplitIntoWords(stop_words_text)) {}
+    explicit SearchServer(std::string_view stop_words_text, const IndexOptions& options = {})
+        : SearchServer(SplitIntoWords(stop_words_text), options) {}
     
     /*
     Метод AddDocument
@@ -54,6 +234,13 @@ public:
     
     /*
     Метод FindTopDocuments
+    Слово запроса с префиксом "-" исключает документы, с префиксом "+" - обязательно для документа.
+    Слова в кавычках образуют фразу: документ должен содержать их подряд (стоп-слова между словами
+    фразы занимают свою позицию, но могут быть любыми, а по краям фразы не учитываются).
+    Фразы требуют IndexOptions::store_positions; без позиций кавычка - обычный символ слова.
+    Слово со звездочкой в конце (кот*) заменяется словами индекса с этим префиксом; обязательное
+    префиксное слово (+кот*) требует от документа хотя бы одного из них.
+    Запрос без обязательных слов и фраз находит документы хотя бы с одним плюс-словом
     */
     
     template <typename DocumentPredicate, typename ExecutionPolicy>
@@ -79,6 +266,34 @@ public:
     
     std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
     
+    /*
+    Метод FindDocumentsAfter (постраничная выдача по курсору)
+    Возвращает не более page_size документов, следующих в порядке ранжирования
+    (релевантность, рейтинг по убыванию, ID по возрастанию) за документом after.
+    Без курсора возвращается первая страница
+    */
+    
+    template <typename DocumentPredicate, typename ExecutionPolicy>
+    std::vector<Document> FindDocumentsAfter(ExecutionPolicy&& policy,
+                                             std::string_view raw_query,
+                                             DocumentPredicate document_predicate,
+                                             const std::optional<Document>& after,
+                                             size_t page_size) const;
+    
+    template <typename ExecutionPolicy>
+    std::vector<Document> FindDocumentsAfter(ExecutionPolicy&& policy,
+                                             std::string_view raw_query,
+                                             DocumentStatus status,
+                                             const std::optional<Document>& after,
+                                             size_t page_size) const;
+    
+    std::vector<Document> FindDocumentsAfter(std::string_view raw_query,
+                                             const std::optional<Document>& after,
+                                             size_t page_size) const;
+    
+    // Порядок ранжирования выдачи: lhs выводится раньше rhs
+    static bool RanksBefore(const Document& lhs, const Document& rhs);
+    
     /*
     Метод MatchDocument
     */
@@ -91,11 +306,33 @@ public:
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(
         const std::execution::parallel_policy&, std::string_view raw_query, int document_id) const;
     
-    // Метод получения частот слов по ID документа
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    /*
+    Метод MatchDocuments (пакетная версия MatchDocument для подсветки результатов)
+    Запрос разбирается один раз, результаты для document_ids возвращаются в том же порядке
+    */
+    
+    template <typename ExecutionPolicy>
+    MatchedDocuments MatchDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+                                    const std::vector<int>& document_ids) const;
+    
+    MatchedDocuments MatchDocuments(std::string_view raw_query, const std::vector<int>& document_ids) const;
+    
+    // Метод получения частот слов по ID документа (для несуществующего ID - пустое представление)
+    WordFrequencies GetWordFrequencies(int document_id) const;
+    
+    // Текст документа; std::nullopt, если он освобожден бюджетом памяти (MemoryBudgetPolicy::EVICT_CONTENT).
+    // Для несуществующего ID - std::out_of_range
+    std::optional<std::string_view> GetDocumentContent(int document_id) const;
     
     size_t GetDocumentCount() const;
     
+    /*
+    Отчет о памяти по структурам индекса и top_posting_lists самых больших списков вхождений.
+    Обходит словарь без копирования данных, поэтому годится для периодического опроса;
+    общий объем также публикуется в метрике search_server_memory_bytes
+    */
+    MemoryReport GetMemoryReport(size_t top_posting_lists = 10) const;
+    
     std::set<int>::const_iterator begin() const {
         return document_ids_.begin();
     }
@@ -105,61 +342,228 @@ public:
     }
     
 private:
-    struct DocumentData {
-        std::string content;
-        int rating;
-        DocumentStatus status;
-    };
-
     const std::set<std::string, std::less<>> stop_words_;
-    // Слово, Документ - TF
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    // Частота слов по ID док-та
-    std::map<int, std::map<std::string_view, double>> document_to_word_freqs_;
-    // Документ, Рейтинг - Статус
-    std::map<int, DocumentData> documents_;
+    const IndexOptions options_;
+    // Словарь всех проиндексированных слов: слово - ID термина. Словарь владеет строками,
+    // на них ссылаются запросы и результаты MatchDocument
+    TermDictionary vocabulary_;
+    // ID термина - список вхождений (порядковый номер док-та, TF)
+    std::vector<PostingList> term_postings_;
+    // ID термина - вхождения по убыванию вклада (только для RankingEngine::IMPACT_ORDERED).
+    // Изменяемый: накопленные изменения списков вливает запрос (FlushImpactIndex)
+    mutable std::vector<ImpactList> term_impacts_;
+    // Число документов при последнем полном пересчете IDF в term_impacts_
+    size_t idf_document_count_ = 0;
+    // ID терминов, списки вкладов которых не влиты: вливаются первым запросом после изменения индекса
+    mutable std::vector<uint32_t> pending_impact_terms_;
+    mutable std::mutex impact_flush_mutex_;
+    mutable std::atomic<bool> impact_lists_pending_ = false;
+    
+    /*
+    Прямой индекс: пары (ID термина, TF) всех документов в общем пуле, внутри документа
+    по возрастанию ID термина. Слова документа с порядковым номером n занимают
+    [forward_offsets_[n], forward_offsets_[n + 1]). Удаленный документ оставляет в пуле
+    неиспользуемый участок; пул уплотняется, когда такие участки занимают больше половины
+    */
+    std::vector<uint32_t> forward_terms_;
+    std::vector<double> forward_freqs_;
+    std::vector<size_t> forward_offsets_{ 0 };
+    size_t forward_garbage_ = 0;
     // Порядковый номер ~ ID док-та
     std::set<int> document_ids_;
     
+    /*
+    Метаданные документов хранятся по колонкам, индексом служит внутренний порядковый номер
+    документа, поэтому при обходе индекса не нужен поиск по ID. Номера выдаются при добавлении
+    по возрастанию; строки удаленных документов освобождаются перенумерацией живых
+    с сохранением порядка (CompactOrdinals)
+    */
+    
+    // ID док-та - порядковый номер
+    std::map<int, int> document_ordinals_;
+    std::vector<int> ordinal_ids_;
+    std::vector<int> ratings_;
+    std::vector<DocumentStatus> statuses_;
+    std::vector<std::string> contents_;
+    // Документы с данным статусом (удаленные документы сброшены во всех картах)
+    std::array<Bitmap, DOCUMENT_STATUS_COUNT> status_bitmaps_;
+    // Строки колонок, оставшиеся за удаленными документами
+    size_t removed_ordinals_ = 0;
+    
+    // Оценка занятой памяти для бюджета: результат последнего GetMemoryReport плюс оценки
+    // документов, добавленных после него. Отчет пересчитывается, когда оценка выходит
+    // за бюджет и индекс с тех пор менялся
+    size_t memory_estimate_ = 0;
+    bool memory_estimate_stale_ = true;
+    // Сумма оценок документов с последнего отчета: большая сумма тоже требует пересчета,
+    // чтобы ошибка оценок не накапливалась
+    size_t memory_unmeasured_bytes_ = 0;
+    // Порядковый номер, с которого продолжается освобождение текстов документов
+    size_t next_evicted_content_ = 0;
+    
+    // Метрики стадий обработки запросов и изменения индекса
+    struct StageMetrics {
+        MetricHistogram& parse;
+        MetricHistogram& posting_scan;
+        MetricHistogram& minus_filter;
+        MetricHistogram& top_k;
+        MetricHistogram& match;
+        MetricHistogram& ingest;
+        MetricHistogram& remove;
+        MetricCounter& queries;
+        MetricGauge& documents;
+        MetricGauge& memory;
+    };
+    
+    static const StageMetrics& GetStageMetrics();
+    
     struct QueryWord {
         std::string_view data;
         bool is_minus;
+        bool is_required;
         bool is_stop;
+        bool is_prefix;
     };
 
     struct Query {
         std::vector<std::string_view> plus_words;
         std::vector<std::string_view> minus_words;
+        // Обязательные слова (+слово) входят и в plus_words: они участвуют в подсчете релевантности
+        std::vector<std::string_view> required_words;
+        // Слова фразы со смещениями внутри нее; слова фраз также считаются обязательными
+        std::vector<std::vector<std::pair<std::string_view, int>>> phrases;
+        // Раскрытия обязательных префиксов (+кот*): документ должен содержать хотя бы одно
+        // слово каждой группы. Сами слова также входят в plus_words
+        std::vector<std::vector<std::string_view>> required_expansions;
+        // Сколько префиксов дали для ранжирования не все свои слова (IndexOptions::max_prefix_expansions)
+        size_t truncated_prefixes = 0;
+        
+        // Запрос ограничивает документы пересечением списков вхождений
+        bool IsConjunctive() const {
+            return !required_words.empty() || !required_expansions.empty();
+        }
     };
     
     bool IsStopWord(std::string_view word) const;
 
     static bool IsValidWord(std::string_view word);
     
-    std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
-    
     static int ComputeAverageRating(const std::vector<int>& ratings);
 
-    double ComputeWordInverseDocumentFreq(std::string_view word) const;
+    double ComputeInverseDocumentFreq(const PostingList& posting_list) const;
+    
+    // Список вхождений слова или nullptr, если слова нет в словаре
+    const PostingList* FindPostingList(std::string_view word) const;
     
     QueryWord ParseQueryWord(std::string_view text) const;
     
     Query ParseQuery(std::string_view raw_query, bool policy_flag = true) const;
     
+    // Слова индекса с префиксом prefix, встречающиеся хотя бы в одном документе, по алфавиту;
+    // не больше limit слов (0 - без ограничения), truncated - были ли отброшены остальные
+    std::vector<std::string_view> ExpandPrefix(std::string_view prefix, size_t limit, bool& truncated) const;
+    
+    int GetOrdinal(int document_id) const;
+    
+    void EraseDocumentMetadata(int document_id, int ordinal);
+    
+    // Приблизительный прирост памяти от документа со словами words (word_count из них - не стоп-слова)
+    size_t EstimateDocumentBytes(std::string_view document, const std::vector<std::string_view>& words,
+                                 size_t word_count) const;
+    
+    // Проверка бюджета перед добавлением документа: при нехватке памяти освобождает тексты
+    // документов (MemoryBudgetPolicy::EVICT_CONTENT) или выбрасывает std::runtime_error
+    void ReserveMemoryBudget(size_t document_bytes);
+    
+    bool IsLiveOrdinal(int ordinal) const;
+    
+    void CompactForwardIndex();
+    
+    // Уплотнение после удаления документа: перенумерация документов или только пула прямого индекса
+    void CompactRemovedDocuments();
+    
+    // Новые порядковые номера живым документам подряд в прежнем порядке: списки вхождений
+    // остаются отсортированными, строки удаленных документов освобождаются во всех колонках
+    void CompactOrdinals();
+    
+    std::optional<uint32_t> FindTermId(std::string_view word) const;
+    
+    // Наличие термина в документе: по прямому индексу или, если он отключен, по списку вхождений
+    bool DocumentHasTerm(int ordinal, uint32_t term_id) const;
+    
+    bool DocumentHasWord(int ordinal, std::string_view word) const;
+    
+    // Слова документа с TF; без прямого индекса - перебором всех списков вхождений
+    std::vector<std::pair<std::string_view, double>> GetDocumentWords(int ordinal) const;
+    
+    // Проверка документа фильтром: DocumentFilter проверяется по битовым картам и колонкам,
+    // произвольный предикат получает значения из колонок
+    template <typename DocumentPredicate>
+    bool IsAccepted(const DocumentPredicate& document_predicate, int ordinal) const;
+    
+    // Документы, содержащие хотя бы одно минус-слово запроса. Строится до подсчета релевантности,
+    // чтобы исключенные документы отбрасывались прямо при обходе индекса плюс-слов
+    Bitmap BuildExclusionBitmap(const Query& query) const;
+    
+    // То же исключение для одного документа - по его словарю частот
+    bool HasMinusWord(const Query& query, int ordinal) const;
+    
+    bool HasRequiredWords(const Query& query, int ordinal) const;
+    
+    // Проверка фраз по позициям: позиции каждого слова сдвигаются на его смещение во фразе
+    // и пересекаются; непустое пересечение - начало вхождения фразы
+    bool MatchesPhrases(const Query& query, int ordinal) const;
+    
+    // Списки вхождений плюс-слов, нужные для бонуса за близость (пусто, если бонус выключен)
+    std::vector<const PostingList*> GetProximityLists(const Query& query) const;
+    
+    double ComputeProximityBoost(const std::vector<const PostingList*>& posting_lists, int ordinal) const;
+    
+    // Обновление индекса вкладов после добавления или перед удалением слов документа
+    void UpdateImpactIndex(const std::vector<std::pair<std::string_view, double>>& word_freqs,
+                           int ordinal, bool is_added);
+    
+    // Запрос обрабатывается индексом вкладов: только плюс- и минус-слова без бонуса за близость
+    bool UsesImpactEngine(const Query& query) const;
+    
+    // Слияние накопленных изменений списков вкладов; безопасно при параллельных запросах
+    void FlushImpactIndex() const;
+    
     /*
     Приватный метод FindAllDocuments
     */
     
-    template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const;
+    template <typename ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindAllDocuments(ExecutionPolicy&& policy, const Query& query,
+                                           DocumentPredicate document_predicate) const;
     
-    template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const std::execution::sequenced_policy&,
-                                           const Query& query, DocumentPredicate document_predicate) const;
+    // Обход подходящих под запрос документов: consumer(document) вызывается по очереди
+    // из одного потока, поэтому может отбирать результат без синхронизации и без общего массива
+    template <typename DocumentPredicate, typename Consumer>
+    void ForEachMatchedDocument(const std::execution::sequenced_policy&, const Query& query,
+                                DocumentPredicate document_predicate, Consumer consumer) const;
+    
+    template <typename DocumentPredicate, typename Consumer>
+    void ForEachMatchedDocument(const std::execution::parallel_policy&, const Query& query,
+                                DocumentPredicate document_predicate, Consumer consumer) const;
     
+    // Поиск по запросу с обязательными словами: кандидаты находятся пересечением их списков
+    // вхождений (начиная с самого короткого), релевантность считается только для выживших
+    template <typename ExecutionPolicy, typename DocumentPredicate, typename Consumer>
+    void FindConjunctiveDocuments(ExecutionPolicy&& policy, const Query& query,
+                                  DocumentPredicate document_predicate, Consumer consumer) const;
+    
+    /*
+    Поиск топа по индексу вкладов (score-at-a-time).
+    Серии вхождений с одинаковым вкладом обходятся по убыванию IDF * вклад. Для каждого документа
+    копятся нижняя и верхняя оценки релевантности, остаток - верхняя граница вклада необработанных
+    серий. Обход останавливается, когда остаток меньше K-й нижней оценки, т.е. непросмотренные
+    документы в топ уже не попадут. Документы, чья верхняя оценка достигает K-й нижней,
+    пересчитываются точно
+    */
     template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const std::execution::parallel_policy&,
-                                           const Query& query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindImpactTopDocuments(const Query& query, DocumentPredicate document_predicate,
+                                                 size_t top_count) const;
     
 };
 
@@ -171,16 +575,27 @@ template <typename DocumentPredicate, typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy,
                                                      std::string_view raw_query,
                                                      DocumentPredicate document_predicate) const {
-    const Query query = ParseQuery(raw_query);
+    GetStageMetrics().queries.Increment();
+    TraceSpan trace_span("FindTopDocuments", true);
+    
+    const Query query = [&] {
+        METRIC_DURATION(GetStageMetrics().parse);
+        TraceSpan parse_span("ParseQuery");
+        return ParseQuery(raw_query);
+    }();
+    trace_span.AddCounter("plus_terms", query.plus_words.size());
+    trace_span.AddCounter("minus_terms", query.minus_words.size());
+    trace_span.AddCounter("truncated_prefixes", query.truncated_prefixes);
     
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
+    auto matched_documents = UsesImpactEngine(query)
+        ? FindImpactTopDocuments(query, document_predicate, MAX_RESULT_DOCUMENT_COUNT)
+        : FindAllDocuments(policy, query, document_predicate);
+    trace_span.AddCounter("matched", matched_documents.size());
 
-    sort(policy, matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-            return std::abs(lhs.relevance - rhs.relevance) < accuracy ?
-                lhs.rating > rhs.rating : lhs.relevance > rhs.relevance;
-        }
-    );
+    METRIC_DURATION(GetStageMetrics().top_k);
+    TraceSpan sort_span("SortTopK");
+    
+    sort(policy, matched_documents.begin(), matched_documents.end(), RanksBefore);
     
     if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
         matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
@@ -193,10 +608,7 @@ template <typename ExecutionPolicy>
 std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy,
                                                      std::string_view raw_query,
                                                      DocumentStatus status) const {
-    return SearchServer::FindTopDocuments(policy, raw_query,
-                                         [&status](int document_id, DocumentStatus doc_status, int rating) {
-                                             return status == doc_status;
-                                         });
+    return SearchServer::FindTopDocuments(policy, raw_query, DocumentFilter{ status });
 }
 
 template <typename ExecutionPolicy>
@@ -205,100 +617,584 @@ std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy,
     return SearchServer::FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
 }
 
+/*
+Реализация шаблонного метода FindDocumentsAfter
+*/
+
+template <typename DocumentPredicate, typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindDocumentsAfter(ExecutionPolicy&& policy,
+                                                       std::string_view raw_query,
+                                                       DocumentPredicate document_predicate,
+                                                       const std::optional<Document>& after,
+                                                       size_t page_size) const {
+    if (page_size < 1) {
+        throw std::invalid_argument("Page size cannot be smaller than 1"s);
+    }
+    
+    GetStageMetrics().queries.Increment();
+    TraceSpan trace_span("FindDocumentsAfter", true);
+    
+    const Query query = [&] {
+        METRIC_DURATION(GetStageMetrics().parse);
+        TraceSpan parse_span("ParseQuery");
+        return ParseQuery(raw_query);
+    }();
+    trace_span.AddCounter("truncated_prefixes", query.truncated_prefixes);
+    
+    // Куча хранит лучшие page_size документов после курсора, на вершине - худший из них.
+    // Документы отбираются сразу по мере подсчета релевантности, поэтому ни полный список
+    // совпадений, ни предыдущие страницы не строятся
+    std::vector<Document> page;
+    int64_t matched = 0;
+    ForEachMatchedDocument(policy, query, document_predicate, [&](const Document& document) {
+        ++matched;
+        if (after && !RanksBefore(*after, document)) {
+            return;
+        }
+        if (page.size() < page_size) {
+            page.push_back(document);
+            std::push_heap(page.begin(), page.end(), RanksBefore);
+        } else if (RanksBefore(document, page.front())) {
+            std::pop_heap(page.begin(), page.end(), RanksBefore);
+            page.back() = document;
+            std::push_heap(page.begin(), page.end(), RanksBefore);
+        }
+    });
+    trace_span.AddCounter("matched", matched);
+    
+    METRIC_DURATION(GetStageMetrics().top_k);
+    TraceSpan select_span("SelectPage");
+    std::sort_heap(page.begin(), page.end(), RanksBefore);
+    
+    return page;
+}
+
+template <typename ExecutionPolicy>
+std::vector<Document> SearchServer::FindDocumentsAfter(ExecutionPolicy&& policy,
+                                                       std::string_view raw_query,
+                                                       DocumentStatus status,
+                                                       const std::optional<Document>& after,
+                                                       size_t page_size) const {
+    return SearchServer::FindDocumentsAfter(policy, raw_query, DocumentFilter{ status }, after, page_size);
+}
+
 template <typename DocumentPredicate>
 std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query,
                                                      DocumentPredicate document_predicate) const {
     return SearchServer::FindTopDocuments(std::execution::seq, raw_query, document_predicate);
 }
 
+template <typename DocumentPredicate>
+bool SearchServer::IsAccepted(const DocumentPredicate& document_predicate, int ordinal) const {
+    if constexpr (std::is_same_v<DocumentPredicate, DocumentFilter>) {
+        return status_bitmaps_[static_cast<size_t>(document_predicate.status)].Test(ordinal)
+            && document_predicate.AcceptsRating(ratings_[ordinal]);
+    } else {
+        // Списки вхождений хранят записи удаленных документов до перенумерации; фильтр по статусу
+        // отбрасывает их битовой картой, а произвольному предикату их не показываем
+        if (removed_ordinals_ != 0 && !IsLiveOrdinal(ordinal)) {
+            return false;
+        }
+        return document_predicate(ordinal_ids_[ordinal], statuses_[ordinal], ratings_[ordinal]);
+    }
+}
+
 /*
 Реализация шаблонного метода FindAllDocuments
 */
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const Query& query,
+template <typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindAllDocuments(ExecutionPolicy&& policy, const Query& query,
                                                      DocumentPredicate document_predicate) const {
+    std::vector<Document> matched_documents;
+    ForEachMatchedDocument(policy, query, document_predicate, [&matched_documents](const Document& document) {
+        matched_documents.push_back(document);
+    });
+    return matched_documents;
+}
+
+template <typename DocumentPredicate, typename Consumer>
+void SearchServer::ForEachMatchedDocument(const std::execution::sequenced_policy&, const Query& query,
+                                          DocumentPredicate document_predicate, Consumer consumer) const {
+    if (query.IsConjunctive()) {
+        FindConjunctiveDocuments(std::execution::seq, query, document_predicate, consumer);
+        return;
+    }
+    
     std::map<int, double> document_to_relevance;
+    TraceSpan trace_span("FindAllDocuments");
+    int64_t postings_scanned = 0;
+    int64_t minus_eliminated = 0;
+    
+    const Bitmap excluded = [&] {
+        METRIC_DURATION(GetStageMetrics().minus_filter);
+        return BuildExclusionBitmap(query);
+    }();
+    
+    {
+        METRIC_DURATION(GetStageMetrics().posting_scan);
         
+        for (std::string_view word : query.plus_words) {
+            const PostingList* posting_list = FindPostingList(word);
+            if (posting_list == nullptr) {
+                continue;
+            }
+            const double inverse_document_freq = ComputeInverseDocumentFreq(*posting_list);
+            postings_scanned += posting_list->Size();
+            
+            for (const auto [ordinal, term_freq] : *posting_list) {
+                if (excluded.Test(ordinal)) {
+                    ++minus_eliminated;
+                } else if (IsAccepted(document_predicate, ordinal)) {
+                    document_to_relevance[ordinal] += term_freq * inverse_document_freq;
+                }
+            }
+        }
+    }
+    
+    trace_span.AddCounter("terms", query.plus_words.size() + query.minus_words.size());
+    trace_span.AddCounter("postings_scanned", postings_scanned);
+    trace_span.AddCounter("candidates", document_to_relevance.size());
+    trace_span.AddCounter("minus_eliminated", minus_eliminated);
+    trace_span.AddCounter("threads", 1);
+    
+    const auto proximity_lists = GetProximityLists(query);
+    
+    for (const auto [ordinal, relevance] : document_to_relevance) {
+        consumer(Document{ ordinal_ids_[ordinal], relevance + ComputeProximityBoost(proximity_lists, ordinal),
+                           ratings_[ordinal] });
+    }
+}
+
+template <typename DocumentPredicate, typename Consumer>
+void SearchServer::ForEachMatchedDocument(const std::execution::parallel_policy&, const Query& query,
+                                          DocumentPredicate document_predicate, Consumer consumer) const {
+    if (query.IsConjunctive()) {
+        FindConjunctiveDocuments(std::execution::par, query, document_predicate, consumer);
+        return;
+    }
+    
+    // Кандидатов не больше, чем вхождений плюс-слов
+    size_t candidate_limit = 0;
     for (std::string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
+        const PostingList* posting_list = FindPostingList(word);
+        candidate_limit += posting_list == nullptr ? 0 : posting_list->Size();
+    }
+    // ConcurrentMap принимает количество сегментов, на которые надо разбить всё пространство ключей,
+    // и ожидаемое число ключей, чтобы таблицы сегментов не увеличивались во время обхода
+    ConcurrentMap<int, double> document_to_relevance(64, candidate_limit);
+    
+    TraceSpan trace_span("FindAllDocuments");
+    std::atomic<int64_t> postings_scanned = 0;
+    std::atomic<int64_t> minus_eliminated = 0;
+    // Потоки, участвовавшие в обработке запроса, собираются только при трассировке
+    std::mutex threads_mutex;
+    std::set<std::thread::id> threads;
+    auto register_thread = [&] {
+        if (trace_span.IsActive()) {
+            std::lock_guard guard(threads_mutex);
+            threads.insert(std::this_thread::get_id());
         }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
+    };
+        
+    // Карта только читается потоками обхода, поэтому строится заранее без синхронизации
+    const Bitmap excluded = [&] {
+        METRIC_DURATION(GetStageMetrics().minus_filter);
+        return BuildExclusionBitmap(query);
+    }();
         
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
+    auto find_condition = [&](std::string_view word) {
+        register_thread();
+        if (const PostingList* posting_list = FindPostingList(word)) {
+            const double inverse_document_freq = ComputeInverseDocumentFreq(*posting_list);
+            postings_scanned += posting_list->Size();
+            
+            int64_t word_eliminated = 0;
+            for (const auto [ordinal, term_freq] : *posting_list) {
+                if (excluded.Test(ordinal)) {
+                    ++word_eliminated;
+                } else if (IsAccepted(document_predicate, ordinal)) {
+                    document_to_relevance[ordinal] += term_freq * inverse_document_freq;
+                }
             }
+            minus_eliminated += word_eliminated;
         }
+    };
+    
+    {
+        METRIC_DURATION(GetStageMetrics().posting_scan);
+        std::for_each(std::execution::par, query.plus_words.begin(), query.plus_words.end(), find_condition);
     }
     
-    for (std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
+    // Порядок обхода сегментов неважен: результаты упорядочивает вызывающий
+    const auto proximity_lists = GetProximityLists(query);
+    int64_t candidates = 0;
+    document_to_relevance.ForEach(std::execution::seq, [&](int ordinal, double relevance) {
+        ++candidates;
+        consumer(Document{ ordinal_ids_[ordinal], relevance + ComputeProximityBoost(proximity_lists, ordinal),
+                           ratings_[ordinal] });
+    });
+    
+    trace_span.AddCounter("terms", query.plus_words.size() + query.minus_words.size());
+    trace_span.AddCounter("postings_scanned", postings_scanned);
+    trace_span.AddCounter("candidates", candidates);
+    trace_span.AddCounter("minus_eliminated", minus_eliminated);
+    trace_span.AddCounter("threads", threads.size());
+}
+
+template <typename ExecutionPolicy, typename DocumentPredicate, typename Consumer>
+void SearchServer::FindConjunctiveDocuments(ExecutionPolicy&& policy, const Query& query,
+                                            DocumentPredicate document_predicate, Consumer consumer) const {
+    TraceSpan trace_span("FindConjunctiveDocuments");
+    
+    const Bitmap excluded = [&] {
+        METRIC_DURATION(GetStageMetrics().minus_filter);
+        return BuildExclusionBitmap(query);
+    }();
+    
+    METRIC_DURATION(GetStageMetrics().posting_scan);
+    
+    std::vector<ArrayView<int>> required_lists;
+    required_lists.reserve(query.required_words.size() + query.required_expansions.size());
+    for (std::string_view word : query.required_words) {
+        const PostingList* posting_list = FindPostingList(word);
+        // Обязательного слова нет ни в одном документе - пересечение пусто
+        if (posting_list == nullptr || posting_list->Empty()) {
+            return;
+        }
+        const auto& ordinals = posting_list->GetOrdinals();
+        required_lists.emplace_back(ordinals.data(), ordinals.size());
+    }
+    // Списки слов обязательного префикса объединяются слиянием в один список
+    int64_t postings_scanned = 0;
+    std::vector<std::vector<int>> expansion_lists(query.required_expansions.size());
+    for (size_t i = 0; i < query.required_expansions.size(); ++i) {
+        std::vector<ArrayView<int>> word_lists;
+        for (std::string_view word : query.required_expansions[i]) {
+            const auto& ordinals = FindPostingList(word)->GetOrdinals();
+            word_lists.emplace_back(ordinals.data(), ordinals.size());
+            postings_scanned += ordinals.size();
         }
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
+        UniteSorted(word_lists, expansion_lists[i]);
+        if (expansion_lists[i].empty()) {
+            return;
         }
+        required_lists.emplace_back(expansion_lists[i].data(), expansion_lists[i].size());
     }
+    std::sort(required_lists.begin(), required_lists.end(),
+              [](const ArrayView<int>& lhs, const ArrayView<int>& rhs) {
+                  return lhs.size() < rhs.size();
+              });
     
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back(
-            { document_id, relevance, documents_.at(document_id).rating }
-        );
+    // Самый редкий список задает начальных кандидатов, остальные только сужают их
+    std::vector<int> candidates(required_lists.front().begin(), required_lists.front().end());
+    postings_scanned += candidates.size();
+    for (size_t i = 1; i < required_lists.size() && !candidates.empty(); ++i) {
+        const ArrayView<int> ordinals = required_lists[i];
+        postings_scanned += ordinals.size();
+        candidates.resize(IntersectSorted(candidates.data(), candidates.size(),
+                                          ordinals.begin(), ordinals.size(), candidates.data()));
     }
     
-    return matched_documents;
+    const size_t intersected = candidates.size();
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                    [&](int ordinal) {
+                                        return excluded.Test(ordinal) || !IsAccepted(document_predicate, ordinal)
+                                            || !MatchesPhrases(query, ordinal);
+                                    }),
+                     candidates.end());
+    
+    // Вклад каждого плюс-слова в релевантность выживших документов
+    std::vector<std::pair<const PostingList*, double>> scoring_words;
+    scoring_words.reserve(query.plus_words.size());
+    for (std::string_view word : query.plus_words) {
+        const PostingList* posting_list = FindPostingList(word);
+        if (posting_list != nullptr && !posting_list->Empty()) {
+            scoring_words.emplace_back(posting_list, ComputeInverseDocumentFreq(*posting_list));
+        }
+    }
+    
+    const auto proximity_lists = GetProximityLists(query);
+    
+    auto compute_relevance = [&](int ordinal) {
+        double relevance = 0.0;
+        for (const auto& [posting_list, inverse_document_freq] : scoring_words) {
+            const size_t position = posting_list->Find(ordinal);
+            if (position != PostingList::NPOS) {
+                relevance += posting_list->GetTermFreq(position) * inverse_document_freq;
+            }
+        }
+        return relevance + ComputeProximityBoost(proximity_lists, ordinal);
+    };
+    
+    if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::parallel_policy>) {
+        // Релевантность выживших считается параллельно, а отдается потребителю по очереди
+        std::vector<double> relevances(candidates.size());
+        std::transform(policy, candidates.begin(), candidates.end(), relevances.begin(), compute_relevance);
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            consumer(Document{ ordinal_ids_[candidates[i]], relevances[i], ratings_[candidates[i]] });
+        }
+    } else {
+        for (const int ordinal : candidates) {
+            consumer(Document{ ordinal_ids_[ordinal], compute_relevance(ordinal), ratings_[ordinal] });
+        }
+    }
+    
+    trace_span.AddCounter("terms", query.plus_words.size() + query.minus_words.size());
+    trace_span.AddCounter("required_terms", query.required_words.size() + query.required_expansions.size());
+    trace_span.AddCounter("phrases", query.phrases.size());
+    trace_span.AddCounter("postings_scanned", postings_scanned);
+    trace_span.AddCounter("candidates", intersected);
+    trace_span.AddCounter("matched", candidates.size());
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const std::execution::sequenced_policy&, const Query& query,
-                                                     DocumentPredicate document_predicate) const {
-    return SearchServer::FindAllDocuments(query, document_predicate);
+std::vector<Document> SearchServer::FindImpactTopDocuments(const Query& query, DocumentPredicate document_predicate,
+                                                           size_t top_count) const {
+    TraceSpan trace_span("FindImpactTopDocuments");
+    
+    FlushImpactIndex();
+    
+    const Bitmap excluded = [&] {
+        METRIC_DURATION(GetStageMetrics().minus_filter);
+        return BuildExclusionBitmap(query);
+    }();
+    
+    METRIC_DURATION(GetStageMetrics().posting_scan);
+    
+    struct TermCursor {
+        const ImpactList* impacts;
+        const PostingList* postings;
+        size_t position;
+        // Точный IDF для итоговой релевантности (кешированный в списке может отставать на дрейф)
+        double exact_idf;
+        
+        // Верхняя граница вклада следующей серии (0 - слово обработано)
+        double NextBound() const {
+            return position < impacts->Size() ? impacts->GetIdf() * impacts->GetImpact(position) / IMPACT_LEVELS : 0.0;
+        }
+    };
+    // Границы считаются по кешированному IDF. Вклад слова в документ не больше его IDF,
+    // поэтому границы отличаются от точных не больше чем на сумму расхождений IDF слов запроса
+    std::vector<TermCursor> cursors;
+    double idf_error = 0.0;
+    for (std::string_view word : query.plus_words) {
+        const auto term_id = FindTermId(word);
+        if (term_id && !term_impacts_[*term_id].Empty()) {
+            const ImpactList& impacts = term_impacts_[*term_id];
+            const PostingList& postings = term_postings_[*term_id];
+            const double exact_idf = ComputeInverseDocumentFreq(postings);
+            cursors.push_back({ &impacts, &postings, 0, exact_idf });
+            idf_error += std::abs(exact_idf - impacts.GetIdf());
+        }
+    }
+    // Порог отсечения занижается на расхождение нижней оценки K-го документа и верхней оценки кандидата
+    const double pruning_slack = accuracy + 2 * idf_error;
+    
+    struct Bounds {
+        double lower = 0.0;
+        double upper = 0.0;
+    };
+    std::unordered_map<int, Bounds> bounds;
+    
+    // Верхняя граница вклада всех необработанных серий
+    auto remaining_bound = [&cursors] {
+        double bound = 0.0;
+        for (const TermCursor& cursor : cursors) {
+            bound += cursor.NextBound();
+        }
+        return bound;
+    };
+    double remaining = remaining_bound();
+    
+    // K-я по величине нижняя оценка; пока документов меньше K, отсечения нет
+    std::vector<double> lowers;
+    auto kth_lower = [&] {
+        if (bounds.size() < top_count) {
+            return -std::numeric_limits<double>::infinity();
+        }
+        lowers.clear();
+        for (const auto& [_, document_bounds] : bounds) {
+            lowers.push_back(document_bounds.lower);
+        }
+        std::nth_element(lowers.begin(), lowers.begin() + (top_count - 1), lowers.end(), std::greater<>());
+        return lowers[top_count - 1];
+    };
+    
+    int64_t postings_scanned = 0;
+    size_t postings_since_check = 0;
+    bool early_terminated = false;
+    double threshold = -std::numeric_limits<double>::infinity();
+    
+    while (std::any_of(cursors.begin(), cursors.end(), [](const TermCursor& cursor) {
+        return cursor.position < cursor.impacts->Size();
+    })) {
+        // Следующая серия - с наибольшим возможным вкладом среди необработанных слов
+        // (при нулевом IDF граница обработанного слова не меньше, чем у остальных)
+        auto cursor = std::max_element(cursors.begin(), cursors.end(),
+                                       [](const TermCursor& lhs, const TermCursor& rhs) {
+                                           const bool lhs_open = lhs.position < lhs.impacts->Size();
+                                           const bool rhs_open = rhs.position < rhs.impacts->Size();
+                                           return lhs_open != rhs_open ? rhs_open : lhs.NextBound() < rhs.NextBound();
+                                       });
+        const ImpactList& impacts = *cursor->impacts;
+        const double idf = impacts.GetIdf();
+        const uint8_t impact = impacts.GetImpact(cursor->position);
+        const size_t level_begin = cursor->position;
+        const size_t level_end = impacts.GetLevelEnd(level_begin);
+        
+        for (; cursor->position < level_end; ++cursor->position) {
+            const int ordinal = impacts.GetOrdinal(cursor->position);
+            if (excluded.Test(ordinal) || !IsAccepted(document_predicate, ordinal)) {
+                continue;
+            }
+            Bounds& document_bounds = bounds[ordinal];
+            document_bounds.lower += idf * (impact - 1) / IMPACT_LEVELS;
+            document_bounds.upper += idf * impact / IMPACT_LEVELS;
+        }
+        remaining = remaining_bound();
+        
+        postings_scanned += level_end - level_begin;
+        postings_since_check += level_end - level_begin;
+        
+        // Проверка останова стоит O(числа документов), поэтому выполняется не после каждой серии
+        if (postings_since_check * 4 >= bounds.size()) {
+            postings_since_check = 0;
+            threshold = kth_lower();
+            if (remaining < threshold - pruning_slack) {
+                early_terminated = remaining > 0;
+                break;
+            }
+        }
+    }
+    if (!early_terminated) {
+        threshold = kth_lower();
+    }
+    
+    // Точный пересчет документов, которые еще могут оказаться в топе
+    std::vector<Document> matched_documents;
+    for (const auto& [ordinal, document_bounds] : bounds) {
+        if (document_bounds.upper + remaining < threshold - pruning_slack) {
+            continue;
+        }
+        double relevance = 0.0;
+        for (const TermCursor& cursor : cursors) {
+            const size_t index = cursor.postings->Find(ordinal);
+            if (index != PostingList::NPOS) {
+                relevance += cursor.postings->GetTermFreq(index) * cursor.exact_idf;
+            }
+        }
+        matched_documents.push_back({ ordinal_ids_[ordinal], relevance, ratings_[ordinal] });
+    }
+    
+    trace_span.AddCounter("terms", query.plus_words.size() + query.minus_words.size());
+    trace_span.AddCounter("postings_scanned", postings_scanned);
+    trace_span.AddCounter("candidates", bounds.size());
+    trace_span.AddCounter("rescored", matched_documents.size());
+    trace_span.AddCounter("early_terminated", early_terminated);
+    
+    return matched_documents;
 }
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const std::execution::parallel_policy&, const Query& query,
-                                                     DocumentPredicate document_predicate) const {
-    std::vector<Document> matched_documents;
-    // ConcurrentMap принимает количество подсловарей, на которые надо разбить всё пространство ключей
-    ConcurrentMap<int, double> document_to_relevance(100);
-    std::map<int, double> document_result;
-        
-    auto find_condition = [&](std::string_view word) {
-        if (word_to_document_freqs_.count(word)) {
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-            
-            for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                const auto& document_data = documents_.at(document_id);
-                if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                    document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
+/*
+Реализация шаблонного метода MatchDocuments
+*/
+
+template <typename ExecutionPolicy>
+MatchedDocuments SearchServer::MatchDocuments(ExecutionPolicy&& policy, std::string_view raw_query,
+                                              const std::vector<int>& document_ids) const {
+    METRIC_DURATION(GetStageMetrics().match);
+    TraceSpan trace_span("MatchDocuments", true);
+    
+    // Все ID проверяются до начала работы, чтобы не возвращать частичный результат
+    std::vector<int> ordinals;
+    ordinals.reserve(document_ids.size());
+    for (const int document_id : document_ids) {
+        if (document_id < 0) {
+            throw std::invalid_argument("Incorrect document ID"s);
+        }
+        ordinals.push_back(GetOrdinal(document_id));
+    }
+    
+    Query query = ParseQuery(raw_query);
+    // Слова переводятся в ID терминов один раз; слова, которых нет в словаре,
+    // не могут совпасть ни с одним документом
+    auto resolve = [this](const std::vector<std::string_view>& words, std::vector<std::string_view>* known) {
+        std::vector<uint32_t> term_ids;
+        for (std::string_view word : words) {
+            if (const auto term_id = FindTermId(word)) {
+                term_ids.push_back(*term_id);
+                if (known != nullptr) {
+                    known->push_back(word);
                 }
             }
         }
+        return term_ids;
     };
+    std::vector<std::string_view> plus_words;
+    const auto plus_terms = resolve(query.plus_words, &plus_words);
+    const auto minus_terms = resolve(query.minus_words, nullptr);
+    const auto required_terms = resolve(query.required_words, nullptr);
+    const bool has_unknown_required = required_terms.size() < query.required_words.size();
+    std::vector<std::vector<uint32_t>> required_expansions;
+    for (const auto& expansion : query.required_expansions) {
+        required_expansions.push_back(resolve(expansion, nullptr));
+    }
+    
+    MatchedDocuments result;
+    result.statuses.resize(document_ids.size());
+    result.offsets.assign(document_ids.size() + 1, 0);
+    
+    // Признаки совпадения плюс-слов по документам, затем по ним заполняется общий массив слов
+    const size_t word_count = plus_terms.size();
+    std::vector<uint8_t> matched(document_ids.size() * word_count, 0);
     
-    std::for_each(std::execution::par, query.plus_words.begin(), query.plus_words.end(), find_condition);
+    // Алгоритмы с политикой могут копировать элементы, поэтому номер документа в пакете
+    // передается явно, а не вычисляется по адресу элемента
+    std::vector<size_t> indexes(ordinals.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
     
-    auto erase_condition = [&](std::string_view word) {
-        if (word_to_document_freqs_.count(word)) {
-            for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-                document_to_relevance.erase(document_id);
+    std::for_each(policy, indexes.begin(), indexes.end(), [&](size_t index) {
+        const int ordinal = ordinals[index];
+        result.statuses[index] = statuses_[ordinal];
+        auto has_term = [this, ordinal](uint32_t term_id) {
+            return DocumentHasTerm(ordinal, term_id);
+        };
+        if (has_unknown_required || std::any_of(minus_terms.begin(), minus_terms.end(), has_term)
+            || !std::all_of(required_terms.begin(), required_terms.end(), has_term)
+            || !std::all_of(required_expansions.begin(), required_expansions.end(),
+                            [&has_term](const std::vector<uint32_t>& expansion) {
+                                return std::any_of(expansion.begin(), expansion.end(), has_term);
+                            })
+            || !MatchesPhrases(query, ordinal)) {
+            return;
+        }
+        
+        size_t count = 0;
+        for (size_t i = 0; i < word_count; ++i) {
+            if (has_term(plus_terms[i])) {
+                matched[index * word_count + i] = 1;
+                ++count;
             }
         }
-    };
+        result.offsets[index + 1] = count;
+    });
     
-    std::for_each(std::execution::par, query.minus_words.begin(), query.minus_words.end(), erase_condition);
+    std::partial_sum(result.offsets.begin(), result.offsets.end(), result.offsets.begin());
+    result.words.resize(result.offsets.back());
     
-    // Метод BuildOrdinaryMap объединяет части словаря и возвращет весь словарь целиком
-    document_result = document_to_relevance.BuildOrdinaryMap();
-    matched_documents.reserve(document_result.size());
+    std::for_each(policy, indexes.begin(), indexes.end(), [&](size_t index) {
+        size_t position = result.offsets[index];
+        for (size_t i = 0; i < word_count; ++i) {
+            if (matched[index * word_count + i]) {
+                result.words[position++] = plus_words[i];
+            }
+        }
+    });
     
-    for (const auto [document_id, relevance] : document_result) {
-        matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
-    }
+    trace_span.AddCounter("documents", document_ids.size());
+    trace_span.AddCounter("terms", word_count + minus_terms.size());
+    trace_span.AddCounter("matched_words", result.words.size());
     
-    return matched_documents;
-}
\ No newline at end of file
+    return result;
+}
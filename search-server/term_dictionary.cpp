@@ -0,0 +1,204 @@
+#include "term_dictionary.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iterator>
+
+namespace {
+
+void AppendVarint(std::vector<uint8_t>& bytes, size_t value) {
+    while (value >= 0x80) {
+        bytes.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back(static_cast<uint8_t>(value));
+}
+
+size_t ReadVarint(const std::vector<uint8_t>& bytes, size_t& offset) {
+    size_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        const uint8_t byte = bytes[offset++];
+        value |= static_cast<size_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+}
+
+} // namespace
+
+/*
+Реализация TermDictionary
+*/
+
+std::optional<uint32_t> TermDictionary::Find(std::string_view term) const {
+    if (slots_.empty()) {
+        return std::nullopt;
+    }
+    const uint32_t id = slots_[FindSlot(term)];
+    if (id == EMPTY_SLOT) {
+        return std::nullopt;
+    }
+    return id;
+}
+
+uint32_t TermDictionary::Insert(std::string_view term) {
+    if ((terms_.size() + 1) * 2 > slots_.size()) {
+        Rehash(std::max(MIN_SLOT_COUNT, slots_.size() * 2));
+    }
+    const size_t slot = FindSlot(term);
+    if (slots_[slot] != EMPTY_SLOT) {
+        return slots_[slot];
+    }
+    const auto id = static_cast<uint32_t>(terms_.size());
+    terms_.push_back(Store(term));
+    slots_[slot] = id;
+    unsorted_ids_.push_back(id);
+    if (unsorted_ids_.size() > std::max(MIN_UNSORTED_TERMS, sorted_ids_.size() / UNSORTED_RATIO)) {
+        MergeUnsorted();
+    }
+    return id;
+}
+
+MemoryUsage TermDictionary::GetMemoryUsage() const {
+    MemoryUsage usage = GetVectorMemoryUsage(terms_);
+    usage += GetVectorMemoryUsage(slots_);
+    usage += GetVectorMemoryUsage(chunks_);
+    usage += GetVectorMemoryUsage(sorted_ids_);
+    usage += GetVectorMemoryUsage(block_offsets_);
+    usage += GetVectorMemoryUsage(block_bytes_);
+    usage += GetVectorMemoryUsage(unsorted_ids_);
+    // Занятая часть блоков - тексты терминов, свободный хвост последнего блока - запас
+    usage.bytes += chunk_bytes_ - (chunk_size_ - chunk_used_);
+    usage.reserved_bytes += chunk_size_ - chunk_used_;
+    usage.overhead_bytes += chunks_.size() * ALLOCATION_OVERHEAD;
+    usage.objects = terms_.size();
+    return usage;
+}
+
+size_t TermDictionary::EstimateTermBytes(std::string_view term) {
+    // Текст, ссылка на него, две ячейки хеш-таблицы, ID в порядке алфавита и разностная запись
+    return term.size() + sizeof(std::string_view) + 3 * sizeof(uint32_t) + 2 + term.size();
+}
+
+size_t TermDictionary::FindSlot(std::string_view term) const {
+    const size_t mask = slots_.size() - 1;
+    size_t slot = std::hash<std::string_view>{}(term) & mask;
+    while (slots_[slot] != EMPTY_SLOT && terms_[slots_[slot]] != term) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+std::string_view TermDictionary::Store(std::string_view term) {
+    if (chunks_.empty() || chunk_used_ + term.size() > chunk_size_) {
+        // Термин длиннее блока получает собственный блок
+        chunk_size_ = std::max(CHUNK_SIZE, term.size());
+        chunks_.push_back(std::make_unique<char[]>(chunk_size_));
+        chunk_bytes_ += chunk_size_;
+        chunk_used_ = 0;
+    }
+    char* data = chunks_.back().get() + chunk_used_;
+    std::memcpy(data, term.data(), term.size());
+    chunk_used_ += term.size();
+    return { data, term.size() };
+}
+
+void TermDictionary::Rehash(size_t slot_count) {
+    slots_.assign(slot_count, EMPTY_SLOT);
+    for (uint32_t id = 0; id < terms_.size(); ++id) {
+        slots_[FindSlot(terms_[id])] = id;
+    }
+}
+
+void TermDictionary::MergeUnsorted() {
+    auto by_text = [this](uint32_t lhs, uint32_t rhs) {
+        return terms_[lhs] < terms_[rhs];
+    };
+    std::sort(unsorted_ids_.begin(), unsorted_ids_.end(), by_text);
+    std::vector<uint32_t> merged;
+    merged.reserve(sorted_ids_.size() + unsorted_ids_.size());
+    std::merge(sorted_ids_.begin(), sorted_ids_.end(), unsorted_ids_.begin(), unsorted_ids_.end(),
+               std::back_inserter(merged), by_text);
+    sorted_ids_ = std::move(merged);
+    unsorted_ids_.clear();
+
+    block_offsets_.clear();
+    block_bytes_.clear();
+    for (size_t i = 0; i < sorted_ids_.size(); ++i) {
+        if (i % BLOCK_TERMS == 0) {
+            block_offsets_.push_back(static_cast<uint32_t>(block_bytes_.size()));
+            continue;
+        }
+        const std::string_view previous = terms_[sorted_ids_[i - 1]];
+        const std::string_view term = terms_[sorted_ids_[i]];
+        const size_t shared = std::mismatch(previous.begin(), previous.end(), term.begin(), term.end()).first
+            - previous.begin();
+        AppendVarint(block_bytes_, shared);
+        AppendVarint(block_bytes_, term.size() - shared);
+        block_bytes_.insert(block_bytes_.end(), term.begin() + shared, term.end());
+    }
+}
+
+std::vector<uint32_t> TermDictionary::GetUnsortedWithPrefix(std::string_view prefix) const {
+    std::vector<uint32_t> ids;
+    for (const uint32_t id : unsorted_ids_) {
+        if (terms_[id].substr(0, prefix.size()) == prefix) {
+            ids.push_back(id);
+        }
+    }
+    std::sort(ids.begin(), ids.end(), [this](uint32_t lhs, uint32_t rhs) {
+        return terms_[lhs] < terms_[rhs];
+    });
+    return ids;
+}
+
+/*
+Реализация TermDictionary::SortedReader
+*/
+
+TermDictionary::SortedReader::SortedReader(const TermDictionary& dictionary, std::string_view from)
+    : dictionary_(dictionary), position_(dictionary.sorted_ids_.size()) {
+    // Первый блок, начинающийся с термина не меньше from; искомый термин может быть в предыдущем
+    const auto& offsets = dictionary_.block_offsets_;
+    size_t low = 0;
+    size_t high = offsets.size();
+    while (low < high) {
+        const size_t middle = (low + high) / 2;
+        if (dictionary_.terms_[dictionary_.sorted_ids_[middle * BLOCK_TERMS]] < from) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (offsets.empty()) {
+        return;
+    }
+    Seek(low > 0 ? low - 1 : 0);
+    while (IsValid() && term_ < from) {
+        Next();
+    }
+}
+
+void TermDictionary::SortedReader::Next() {
+    if (++position_ >= dictionary_.sorted_ids_.size()) {
+        return;
+    }
+    if (position_ % BLOCK_TERMS == 0) {
+        Seek(position_ / BLOCK_TERMS);
+        return;
+    }
+    const std::vector<uint8_t>& bytes = dictionary_.block_bytes_;
+    const size_t shared = ReadVarint(bytes, offset_);
+    const size_t suffix = ReadVarint(bytes, offset_);
+    term_.resize(shared);
+    term_.append(reinterpret_cast<const char*>(bytes.data() + offset_), suffix);
+    offset_ += suffix;
+}
+
+void TermDictionary::SortedReader::Seek(size_t block) {
+    position_ = block * BLOCK_TERMS;
+    offset_ = dictionary_.block_offsets_[block];
+    term_ = dictionary_.terms_[dictionary_.sorted_ids_[position_]];
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "memory_usage.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+Словарь терминов индекса: слово - ID термина и обратно.
+Текст каждого термина хранится один раз - в общих блоках памяти, которые не перемещаются,
+поэтому string_view, полученные от словаря, действительны все время его жизни. ID по слову
+ищется в хеш-таблице с открытой адресацией и линейным пробированием, ячейки которой хранят
+только ID терминов, поэтому поиск не выделяет памяти.
+Для обхода по алфавиту термины упорядочены в блоки по BLOCK_TERMS: первый термин блока
+берется из блоков текстов, остальные закодированы разностно относительно предыдущего
+(длина общего префикса и суффикс). Новые термины копятся в неупорядоченном хвосте и вливаются
+в блоки, когда хвост вырастает до доли словаря
+*/
+
+class TermDictionary {
+public:
+    std::optional<uint32_t> Find(std::string_view term) const;
+
+    // ID термина; новый термин копируется в словарь и получает следующий ID
+    uint32_t Insert(std::string_view term);
+
+    std::string_view GetTerm(uint32_t id) const {
+        return terms_[id];
+    }
+
+    // Тексты терминов по ID (действительно до следующей вставки)
+    const std::vector<std::string_view>& GetTerms() const {
+        return terms_;
+    }
+
+    size_t Size() const {
+        return terms_.size();
+    }
+
+    // ID терминов с префиксом prefix по алфавиту (пустой префикс - все термины);
+    // обход продолжается, пока callback(id) возвращает true
+    template <typename Callback>
+    void ForEachWithPrefix(std::string_view prefix, Callback callback) const;
+
+    MemoryUsage GetMemoryUsage() const;
+
+    // Приблизительный прирост памяти словаря при вставке нового термина term
+    static size_t EstimateTermBytes(std::string_view term);
+
+private:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+    static constexpr size_t MIN_SLOT_COUNT = 16;
+    static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+    static constexpr size_t BLOCK_TERMS = 16;
+    // Хвост вливается в блоки, когда он длиннее MIN_UNSORTED_TERMS и 1/UNSORTED_RATIO словаря
+    static constexpr size_t MIN_UNSORTED_TERMS = 256;
+    static constexpr size_t UNSORTED_RATIO = 16;
+
+    // Последовательное чтение упорядоченных блоков, начиная с первого термина не меньше from
+    class SortedReader {
+    public:
+        SortedReader(const TermDictionary& dictionary, std::string_view from);
+
+        bool IsValid() const {
+            return position_ < dictionary_.sorted_ids_.size();
+        }
+        uint32_t GetId() const {
+            return dictionary_.sorted_ids_[position_];
+        }
+        // Действительно до следующего Next
+        std::string_view GetTerm() const {
+            return term_;
+        }
+        void Next();
+
+    private:
+        const TermDictionary& dictionary_;
+        size_t position_ = 0;
+        size_t offset_ = 0;
+        std::string term_;
+
+        void Seek(size_t block);
+    };
+
+    std::vector<std::string_view> terms_;
+    // ID терминов по хешу текста; таблица заполнена не больше чем наполовину
+    std::vector<uint32_t> slots_;
+    // Блоки с текстами терминов: заполняется последний
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    size_t chunk_size_ = 0;
+    size_t chunk_used_ = 0;
+    size_t chunk_bytes_ = 0;
+    // ID терминов по алфавиту и разностная запись терминов, кроме первого в блоке;
+    // block_offsets_[b] - начало записи блока b в block_bytes_
+    std::vector<uint32_t> sorted_ids_;
+    std::vector<uint32_t> block_offsets_;
+    std::vector<uint8_t> block_bytes_;
+    // Термины, вставленные после последнего слияния, в порядке вставки
+    std::vector<uint32_t> unsorted_ids_;
+
+    // Ячейка с термином term или пустая ячейка, в которую его нужно вставить
+    size_t FindSlot(std::string_view term) const;
+
+    std::string_view Store(std::string_view term);
+
+    void Rehash(size_t slot_count);
+
+    // Вливание хвоста в упорядоченные термины и перестроение блоков
+    void MergeUnsorted();
+
+    // Термины хвоста с префиксом prefix по алфавиту
+    std::vector<uint32_t> GetUnsortedWithPrefix(std::string_view prefix) const;
+};
+
+template <typename Callback>
+void TermDictionary::ForEachWithPrefix(std::string_view prefix, Callback callback) const {
+    // Слияние блоков с отсортированными терминами хвоста
+    const std::vector<uint32_t> unsorted = GetUnsortedWithPrefix(prefix);
+    auto next_unsorted = unsorted.begin();
+    SortedReader reader(*this, prefix);
+    while (true) {
+        const bool has_sorted = reader.IsValid() && reader.GetTerm().substr(0, prefix.size()) == prefix;
+        if (!has_sorted && next_unsorted == unsorted.end()) {
+            return;
+        }
+        uint32_t id = 0;
+        if (!has_sorted || (next_unsorted != unsorted.end() && terms_[*next_unsorted] < reader.GetTerm())) {
+            id = *next_unsorted++;
+        } else {
+            id = reader.GetId();
+            reader.Next();
+        }
+        if (!callback(id)) {
+            return;
+        }
+    }
+}
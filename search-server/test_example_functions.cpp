@@ -1 +1,1241 @@
-#include "test_example_functions.h"
\ No newline at end of file
+#include "test_example_functions.h"
+
+#include "batch_processor.h"
+#include "concurrent_map.h"
+#include "corpus_generator.h"
+#include "metrics.h"
+#include "paginator.h"
+#include "posting_list.h"
+#include "request_queue.h"
+#include "search_server.h"
+#include "term_dictionary.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <execution>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+void AssertImpl(bool value, const string& expr_str, const string& file, const string& func,
+                unsigned line, const string& hint) {
+    if (!value) {
+        cerr << file << "("s << line << "): "s << func << ": "s;
+        cerr << "ASSERT("s << expr_str << ") failed."s;
+        if (!hint.empty()) {
+            cerr << " Hint: "s << hint;
+        }
+        cerr << endl;
+        abort();
+    }
+}
+
+/*
+Очередь запросов
+*/
+
+void TestRequestQueueWindows() {
+    SearchServer search_server(""s);
+    RequestQueue request_queue(search_server);
+    const auto start = RequestQueue::Clock::now();
+    
+    for (int i = 0; i < 99; ++i) {
+        request_queue.RecordRequest(chrono::microseconds(100), 1, start);
+    }
+    request_queue.RecordRequest(chrono::microseconds(10'000), 0, start);
+    request_queue.RecordRequest(chrono::microseconds(200), 0, start + chrono::minutes(10));
+    
+    {
+        const RequestStats stats = request_queue.GetStats(chrono::minutes(5), start + chrono::minutes(10));
+        ASSERT_EQUAL(stats.requests, 1u);
+        ASSERT_EQUAL(stats.no_result_requests, 1u);
+        ASSERT_EQUAL(stats.no_result_rate, 1.0);
+    }
+    {
+        const RequestStats stats = request_queue.GetStats(chrono::minutes(60), start + chrono::minutes(10));
+        ASSERT_EQUAL(stats.requests, 101u);
+        ASSERT_EQUAL(stats.no_result_requests, 2u);
+        ASSERT(stats.qps > 0.0);
+        // Загрубленные корзины дают оценку сверху с погрешностью не больше четверти октавы
+        ASSERT(stats.latency_p50.count() >= 100 && stats.latency_p50.count() <= 125);
+        ASSERT(stats.latency_p999.count() >= 10'000 && stats.latency_p999.count() <= 12'500);
+    }
+    
+    // Задержки за пределами шкалы не теряются
+    request_queue.RecordRequest(chrono::hours(1), 1, start + chrono::minutes(11));
+    const RequestStats stats = request_queue.GetStats(chrono::minutes(1), start + chrono::minutes(11));
+    ASSERT_EQUAL(stats.requests, 1u);
+    ASSERT(stats.latency_p50 >= chrono::minutes(2));
+}
+
+void TestRequestQueueExpiration() {
+    SearchServer search_server(""s);
+    RequestQueue request_queue(search_server);
+    const auto start = RequestQueue::Clock::now();
+    
+    request_queue.RecordRequest(chrono::microseconds(100), 0, start);
+    request_queue.RecordRequest(chrono::microseconds(100), 0, start + chrono::minutes(10));
+    request_queue.RecordRequest(chrono::microseconds(100), 1, start + chrono::minutes(10));
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(start + chrono::minutes(10)), 2);
+    
+    // Через сутки первая минута выходит из окна
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(start + chrono::minutes(1441)), 1);
+    ASSERT_EQUAL(request_queue.GetStats(chrono::minutes(1440), start + chrono::minutes(1441)).requests, 2u);
+    
+    // Новая минута занимает корзину первой и сбрасывает ее прежние данные
+    request_queue.RecordRequest(chrono::microseconds(100), 1, start + chrono::minutes(1440));
+    ASSERT_EQUAL(request_queue.GetStats(chrono::minutes(1), start + chrono::minutes(1440)).requests, 1u);
+    ASSERT_EQUAL(request_queue.GetStats(chrono::minutes(1440), start + chrono::minutes(1441)).requests, 3u);
+    
+    // Запрос старше окна не учитывается
+    request_queue.RecordRequest(chrono::microseconds(100), 0, start);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(start + chrono::minutes(1441)), 1);
+    
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(start + chrono::minutes(1451)), 0);
+    ASSERT_EQUAL(request_queue.GetStats(chrono::minutes(1440), start + chrono::minutes(1451)).requests, 1u);
+    ASSERT_EQUAL(request_queue.GetStats(chrono::minutes(1440), start + chrono::minutes(3000)).requests, 0u);
+}
+
+/*
+Метрики
+*/
+
+void TestPrometheusFormat() {
+    MetricsRegistry registry;
+    registry.GetCounter("test_requests_total"s, "Requests"s).Increment(5);
+    registry.GetGauge("test_documents"s, "Documents"s, "shard=\"1\""s).Set(2.5);
+    // Наносекунды, экспортируемые в микросекундах
+    MetricHistogram& histogram = registry.GetHistogram("test_latency_us"s, "Latency"s, "stage=\"parse\""s, 1e-3);
+    histogram.Observe(1000);
+    histogram.Observe(3000);
+    
+    // Имя уже занято метрикой другого типа
+    try {
+        registry.GetGauge("test_requests_total"s, "Requests"s);
+        ASSERT_HINT(false, "type conflict must throw"s);
+    } catch (const invalid_argument&) {
+    }
+    
+    ostringstream out;
+    registry.WritePrometheus(out);
+    const string text = out.str();
+    auto contains = [&text](const string& line) {
+        return text.find(line + "\n"s) != string::npos;
+    };
+    
+    ASSERT(contains("# HELP test_requests_total Requests"s));
+    ASSERT(contains("# TYPE test_requests_total counter"s));
+    ASSERT(contains("# TYPE test_documents gauge"s));
+    ASSERT(contains("# TYPE test_latency_us histogram"s));
+#ifndef SEARCH_SERVER_NO_METRICS
+    ASSERT(contains("test_requests_total 5"s));
+    ASSERT(contains("test_documents{shard=\"1\"} 2.5"s));
+    // Границы le - верхние границы логарифмических корзин в единицах экспорта, счетчики накопительные
+    ASSERT(contains("test_latency_us_bucket{stage=\"parse\",le=\"1.007\"} 1"s));
+    ASSERT(contains("test_latency_us_bucket{stage=\"parse\",le=\"1.023\"} 1"s));
+    ASSERT(contains("test_latency_us_bucket{stage=\"parse\",le=\"3.007\"} 2"s));
+    ASSERT(contains("test_latency_us_bucket{stage=\"parse\",le=\"+Inf\"} 2"s));
+    ASSERT(contains("test_latency_us_sum{stage=\"parse\"} 4"s));
+    ASSERT(contains("test_latency_us_count{stage=\"parse\"} 2"s));
+    // Корзины выводятся от первой до последней непустой
+    ASSERT(!contains("test_latency_us_bucket{stage=\"parse\",le=\"0.991\"} 0"s));
+    ASSERT(text.find("le=\"3.071\""s) == string::npos);
+#else
+    // В сборке без метрик значения не обновляются
+    ASSERT(contains("test_requests_total 0"s));
+    ASSERT(contains("test_latency_us_count{stage=\"parse\"} 0"s));
+#endif
+}
+
+/*
+Трассировка
+*/
+
+void TestTraceRing() {
+    Tracer tracer(64);
+    ASSERT(tracer.Collect().empty());
+    
+    // Читатель работает одновременно с писателями и не должен получить спан, собранный из двух записей
+    atomic<bool> stop{ false };
+    thread reader([&] {
+        while (!stop.load()) {
+            for (const TraceEvent& event : tracer.Collect()) {
+                ASSERT_EQUAL(event.start_ns, static_cast<int64_t>(event.trace_id));
+                ASSERT_EQUAL(event.duration_ns, static_cast<int64_t>(event.trace_id) * 2);
+                ASSERT_EQUAL(event.counters[0].value, static_cast<int64_t>(event.trace_id) * 3);
+            }
+        }
+    });
+    vector<thread> writers;
+    for (int thread_index = 0; thread_index < 4; ++thread_index) {
+        writers.emplace_back([&tracer, thread_index] {
+            for (int i = 0; i < 5'000; ++i) {
+                TraceEvent event;
+                event.name = "span";
+                event.trace_id = thread_index * 5'000 + i;
+                event.start_ns = event.trace_id;
+                event.duration_ns = event.trace_id * 2;
+                event.counter_count = 1;
+                event.counters[0] = TraceCounter{ "value", event.start_ns * 3 };
+                tracer.Record(event);
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    stop = true;
+    reader.join();
+    
+    // В буфере остаются только последние спаны
+    ASSERT_EQUAL(tracer.Collect().size(), 64u);
+}
+
+void TestTraceSampling() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "пушистый кот"s, DocumentStatus::ACTUAL, { 1 });
+    
+    ASSERT(!Tracer::IsEnabled());
+    Tracer::SetSampling(1);
+    search_server.FindTopDocuments("кот"s);
+    Tracer::SetSampling(0);
+    const size_t event_count = Tracer::Instance().Collect().size();
+    search_server.FindTopDocuments("кот"s);
+    ASSERT_EQUAL(Tracer::Instance().Collect().size(), event_count);
+    
+    // Вложенные спаны запроса относятся к той же трассе, что и корневой
+    uint64_t trace_id = 0;
+    int parse_spans = 0;
+    for (const TraceEvent& event : Tracer::Instance().Collect()) {
+        if (event.name == "FindTopDocuments"s) {
+            trace_id = event.trace_id;
+        }
+    }
+    ASSERT(trace_id != 0);
+    for (const TraceEvent& event : Tracer::Instance().Collect()) {
+        parse_spans += event.name == "ParseQuery"s && event.trace_id == trace_id;
+    }
+    ASSERT_EQUAL(parse_spans, 1);
+    
+    ostringstream out;
+    Tracer::Instance().WriteChromeTrace(out);
+    ASSERT(out.str().find("\"name\":\"FindTopDocuments\""s) != string::npos);
+}
+
+/*
+Постраничная выдача по курсору
+*/
+
+namespace {
+
+// Документы с частыми совпадениями оценок: у многих одинаковые текст и рейтинг
+void AddPaginationDocuments(SearchServer& search_server, int document_count) {
+    for (int id = 0; id < document_count; ++id) {
+        const string text = id % 3 == 0 ? "кот пес"s : id % 3 == 1 ? "кот кот"s : "пес"s;
+        search_server.AddDocument(id, text + " слово"s + to_string(id % 2), DocumentStatus::ACTUAL, { id % 4 });
+    }
+}
+
+// Сквозной обход выдачи страницами по page_size документов
+template <typename ExecutionPolicy>
+vector<Document> CollectPages(const SearchServer& search_server, ExecutionPolicy policy,
+                              const string& query, size_t page_size) {
+    vector<Document> documents;
+    optional<Document> cursor;
+    while (true) {
+        const auto page = search_server.FindDocumentsAfter(policy, query, DocumentStatus::ACTUAL, cursor, page_size);
+        ASSERT(page.size() <= page_size);
+        documents.insert(documents.end(), page.begin(), page.end());
+        if (page.size() < page_size) {
+            return documents;
+        }
+        cursor = page.back();
+    }
+}
+
+} // namespace
+
+void TestCursorPagination() {
+    SearchServer search_server(""s);
+    AddPaginationDocuments(search_server, 60);
+    const string query = "кот пес"s;
+    
+    const auto all = search_server.FindDocumentsAfter(execution::seq, query, DocumentStatus::ACTUAL, nullopt, 1000);
+    ASSERT_EQUAL(all.size(), 60u);
+    // Порядок полный: при равных релевантности и рейтинге раньше идет меньший ID
+    for (size_t i = 1; i < all.size(); ++i) {
+        ASSERT(SearchServer::RanksBefore(all[i - 1], all[i]));
+        if (abs(all[i - 1].relevance - all[i].relevance) < 1e-6 && all[i - 1].rating == all[i].rating) {
+            ASSERT(all[i - 1].id < all[i].id);
+        }
+    }
+    
+    // Страницы любого размера складываются в ту же выдачу без пропусков и повторов
+    auto same_ids = [](const vector<Document>& lhs, const vector<Document>& rhs) {
+        return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document& l, const Document& r) {
+            return l.id == r.id;
+        });
+    };
+    for (size_t page_size : { 1u, 4u, 7u, 60u, 100u }) {
+        ASSERT_HINT(same_ids(CollectPages(search_server, execution::seq, query, page_size), all), to_string(page_size));
+        ASSERT_HINT(same_ids(CollectPages(search_server, execution::par, query, page_size), all), to_string(page_size));
+    }
+    
+    vector<Document> paginated;
+    for (const auto& page : PaginateSearch(search_server, query, 8)) {
+        paginated.insert(paginated.end(), page.begin(), page.end());
+    }
+    ASSERT(same_ids(paginated, all));
+}
+
+void TestCursorAtRemovedDocument() {
+    SearchServer search_server(""s);
+    AddPaginationDocuments(search_server, 60);
+    const string query = "кот пес"s;
+    
+    const auto first_page = search_server.FindDocumentsAfter(query, nullopt, 10);
+    const Document cursor = first_page.back();
+    search_server.RemoveDocument(cursor.id);
+    
+    // Удаленный документ остается точкой отсчета: выдача продолжается с документов, идущих после него
+    const auto all = search_server.FindDocumentsAfter(execution::seq, query, DocumentStatus::ACTUAL, nullopt, 1000);
+    vector<int> expected;
+    for (const Document& document : all) {
+        if (SearchServer::RanksBefore(cursor, document)) {
+            expected.push_back(document.id);
+        }
+    }
+    ASSERT(!expected.empty());
+    
+    vector<int> rest;
+    optional<Document> next = cursor;
+    while (true) {
+        const auto page = search_server.FindDocumentsAfter(execution::seq, query, DocumentStatus::ACTUAL, next, 10);
+        for (const Document& document : page) {
+            ASSERT(document.id != cursor.id);
+            rest.push_back(document.id);
+        }
+        if (page.size() < 10) {
+            break;
+        }
+        next = page.back();
+    }
+    ASSERT(rest == expected);
+}
+
+/*
+Фильтр по статусу и рейтингу
+*/
+
+namespace {
+
+// Документы с разными статусами и рейтингами: тексты из небольшого словаря дают много совпадений
+vector<string> MakeFilterDocuments(int document_count) {
+    const vector<string> words = { "кот"s, "пес"s, "белый"s, "черный"s, "хвост"s, "ошейник"s, "модный"s };
+    vector<string> documents;
+    for (int id = 0; id < document_count; ++id) {
+        string text;
+        for (int i = 0; i < 4; ++i) {
+            text += words[(id * 7 + i * (id % 5 + 1)) % words.size()] + " "s;
+        }
+        documents.push_back(text);
+    }
+    return documents;
+}
+
+DocumentStatus StatusForTest(int document_id) {
+    return static_cast<DocumentStatus>(document_id % DOCUMENT_STATUS_COUNT);
+}
+
+int RatingForTest(int document_id) {
+    return document_id % 7 - 3;
+}
+
+bool SameDocuments(const vector<Document>& lhs, const vector<Document>& rhs) {
+    return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document& l, const Document& r) {
+        return l.id == r.id && abs(l.relevance - r.relevance) < 1e-9 && l.rating == r.rating;
+    });
+}
+
+} // namespace
+
+void TestStatusPushdown() {
+    SearchServer search_server("и в на"s);
+    const vector<string> documents = MakeFilterDocuments(400);
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        search_server.AddDocument(id, documents[id], StatusForTest(id), { RatingForTest(id) });
+    }
+    const vector<string> queries = { "кот"s, "белый пес -хвост"s, "модный ошейник черный"s, "+кот хвост"s };
+    
+    // Фильтр проверяется по битовым картам и колонке рейтингов, предикат - по значениям документа;
+    // выдача должна совпадать
+    auto check = [&](const set<int>& removed) {
+        for (const string& query : queries) {
+            for (size_t status_index = 0; status_index < DOCUMENT_STATUS_COUNT; ++status_index) {
+                const auto status = static_cast<DocumentStatus>(status_index);
+                auto by_status = [status](int, DocumentStatus document_status, int) {
+                    return document_status == status;
+                };
+                ASSERT_HINT(SameDocuments(search_server.FindTopDocuments(query, status),
+                                          search_server.FindTopDocuments(query, by_status)), query);
+                ASSERT_HINT(SameDocuments(search_server.FindTopDocuments(execution::par, query, status),
+                                          search_server.FindTopDocuments(execution::par, query, by_status)), query);
+                
+                const DocumentFilter filter{ status, -1, 2 };
+                auto by_filter = [status](int, DocumentStatus document_status, int rating) {
+                    return document_status == status && -1 <= rating && rating <= 2;
+                };
+                const auto filtered = search_server.FindDocumentsAfter(execution::seq, query, filter, nullopt, 1000);
+                ASSERT_HINT(SameDocuments(filtered,
+                    search_server.FindDocumentsAfter(execution::seq, query, by_filter, nullopt, 1000)), query);
+                ASSERT_HINT(SameDocuments(filtered,
+                    search_server.FindDocumentsAfter(execution::par, query, filter, nullopt, 1000)), query);
+                for (const Document& document : filtered) {
+                    ASSERT(StatusForTest(document.id) == status);
+                    ASSERT(filter.AcceptsRating(document.rating));
+                    ASSERT(removed.count(document.id) == 0);
+                }
+            }
+        }
+    };
+    check({});
+    
+    // Удаление большей части документов сжимает внутренние номера и перестраивает битовые карты
+    set<int> removed;
+    for (int id = 0; id < static_cast<int>(documents.size()); id += 3) {
+        search_server.RemoveDocument(id);
+        removed.insert(id);
+    }
+    for (int id = 1; id < static_cast<int>(documents.size()); id += 9) {
+        search_server.RemoveDocument(execution::par, id);
+        removed.insert(id);
+    }
+    check(removed);
+}
+
+/*
+Исключение документов по минус-словам
+*/
+
+void TestMinusWordExclusion() {
+    SearchServer search_server("и в на"s);
+    const vector<string> documents = MakeFilterDocuments(300);
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, { RatingForTest(id) });
+    }
+    
+    // Удалений больше, чем нужно для сжатия внутренних номеров
+    SearchServer expected_server("и в на"s);
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        if (id % 2 == 0 || id % 5 == 0) {
+            search_server.RemoveDocument(id);
+        } else {
+            expected_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, { RatingForTest(id) });
+        }
+    }
+    ASSERT_EQUAL(search_server.GetDocumentCount(), expected_server.GetDocumentCount());
+    
+    // Сервер после удалений отвечает так же, как сервер, в который удаленные документы не добавлялись
+    const vector<string> queries = { "кот -пес"s, "белый черный -хвост -ошейник"s, "-кот пес"s,
+                                     "+модный -белый"s, "кот -несуществующее"s };
+    for (const string& query : queries) {
+        const auto expected = expected_server.FindDocumentsAfter(execution::seq, query, DocumentStatus::ACTUAL,
+                                                                 nullopt, 1000);
+        ASSERT_HINT(SameDocuments(search_server.FindDocumentsAfter(execution::seq, query, DocumentStatus::ACTUAL,
+                                                                   nullopt, 1000), expected), query);
+        ASSERT_HINT(SameDocuments(search_server.FindDocumentsAfter(execution::par, query, DocumentStatus::ACTUAL,
+                                                                   nullopt, 1000), expected), query);
+        ASSERT_HINT(SameDocuments(search_server.FindTopDocuments(execution::par, query),
+                                  expected_server.FindTopDocuments(query)), query);
+    }
+    
+    // Документ с минус-словом не совпадает с запросом, даже если содержит плюс-слова
+    for (const int document_id : search_server) {
+        const auto [words, status] = search_server.MatchDocument("кот пес -хвост"s, document_id);
+        const bool has_minus_word = documents[document_id].find("хвост"s) != string::npos;
+        ASSERT_EQUAL(words.empty(), has_minus_word || (documents[document_id].find("кот"s) == string::npos
+                                                       && documents[document_id].find("пес"s) == string::npos));
+        const auto [par_words, par_status] = search_server.MatchDocument(execution::par, "кот пес -хвост"s, document_id);
+        ASSERT(par_words == words);
+    }
+}
+
+/*
+Пакетное сопоставление документов с запросом
+*/
+
+void TestMatchDocumentsBatch() {
+    SearchServer search_server("и в на"s);
+    const vector<string> documents = MakeFilterDocuments(200);
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        search_server.AddDocument(id, documents[id], StatusForTest(id), { RatingForTest(id) });
+    }
+    for (int id = 0; id < static_cast<int>(documents.size()); id += 4) {
+        search_server.RemoveDocument(id);
+    }
+    
+    // Пакет с повторами и в произвольном порядке
+    vector<int> document_ids;
+    for (int id = 199; id > 0; id -= 3) {
+        if (id % 4 != 0) {
+            document_ids.push_back(id);
+        }
+    }
+    document_ids.push_back(document_ids.front());
+    
+    const vector<string> queries = { "кот пес"s, "кот кот -хвост"s, "+белый черный модный"s,
+                                     "+несуществующее кот"s, "ко* -пе*"s, "несуществующее"s };
+    for (const string& query : queries) {
+        const MatchedDocuments seq_result = search_server.MatchDocuments(execution::seq, query, document_ids);
+        const MatchedDocuments par_result = search_server.MatchDocuments(execution::par, query, document_ids);
+        ASSERT_EQUAL(seq_result.size(), document_ids.size());
+        ASSERT_EQUAL(par_result.size(), document_ids.size());
+        for (size_t i = 0; i < document_ids.size(); ++i) {
+            const auto [words, status] = search_server.MatchDocument(query, document_ids[i]);
+            const auto seq_words = seq_result.GetWords(i);
+            const auto par_words = par_result.GetWords(i);
+            ASSERT_HINT(vector<string_view>(seq_words.begin(), seq_words.end()) == words, query);
+            ASSERT_HINT(vector<string_view>(par_words.begin(), par_words.end()) == words, query);
+            ASSERT(seq_result.statuses[i] == status);
+            ASSERT(par_result.statuses[i] == status);
+        }
+    }
+    ASSERT_EQUAL(search_server.MatchDocuments("кот"s, {}).size(), 0u);
+    
+    // Удаленный или отсутствующий ID отклоняется так же, как в MatchDocument, и без частичного результата
+    for (const int missing_id : { 0, 1000 }) {
+        try {
+            search_server.MatchDocuments(execution::par, "кот"s, { 1, missing_id });
+            ASSERT_HINT(false, to_string(missing_id));
+        } catch (const out_of_range&) {
+        }
+    }
+    try {
+        search_server.MatchDocuments("кот"s, { 1, -1 });
+        ASSERT_HINT(false, "negative ID must be rejected"s);
+    } catch (const invalid_argument&) {
+    }
+}
+
+/*
+Удаление документов до перенумерации
+*/
+
+void TestPostingListErase() {
+    PostingList postings;
+    for (int ordinal = 0; ordinal < 10; ++ordinal) {
+        postings.Add(ordinal, ordinal + 1.0, static_cast<uint32_t>(ordinal * 10), 0);
+        postings.Add(ordinal, 0.0, static_cast<uint32_t>(ordinal * 10 + 2), 0);
+    }
+    ASSERT_EQUAL(postings.Erase(3), 1u);
+    ASSERT_EQUAL(postings.Erase(7), 1u);
+    ASSERT_EQUAL(postings.Erase(42), 0u);
+    
+    // Записи удаленных документов остаются до перенумерации, но не считаются в размере
+    ASSERT_EQUAL(postings.Size(), 8u);
+    ASSERT_EQUAL(postings.GetOrdinals().size(), 10u);
+    ASSERT(postings.Contains(3));
+    
+    vector<int> new_ordinals(10, -1);
+    int ordinal_count = 0;
+    for (int ordinal = 0; ordinal < 10; ++ordinal) {
+        if (ordinal != 3 && ordinal != 7) {
+            new_ordinals[ordinal] = ordinal_count++;
+        }
+    }
+    postings.Renumber(new_ordinals);
+    ASSERT_EQUAL(postings.Size(), 8u);
+    ASSERT_EQUAL(postings.GetOrdinals().size(), 8u);
+    
+    // Бывший документ 4 получил номер 3 вместе со своей частотой и позициями
+    const size_t index = postings.Find(3);
+    ASSERT(index != PostingList::NPOS);
+    ASSERT_EQUAL(postings.GetTermFreq(index), 5.0);
+    vector<int> positions;
+    postings.GetPositions(index, positions);
+    ASSERT(positions == vector<int>({ 40, 42 }));
+    ASSERT(postings.Find(8) == PostingList::NPOS);
+}
+
+void TestRemovalBeforeCompaction() {
+    SearchServer search_server("и в на"s);
+    SearchServer expected_server("и в на"s);
+    const vector<string> documents = MakeFilterDocuments(300);
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, { RatingForTest(id) });
+        if (id % 10 != 0) {
+            expected_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, { RatingForTest(id) });
+        }
+    }
+    // Удалений меньше половины: внутренние номера не сжимаются
+    for (int id = 0; id < static_cast<int>(documents.size()); id += 10) {
+        search_server.RemoveDocument(id);
+    }
+    
+    // IDF считается по живым документам, а произвольный предикат не видит удаленных
+    const auto any_document = [](int, DocumentStatus, int) {
+        return true;
+    };
+    const vector<string> queries = { "кот"s, "белый -пес"s, "+модный хвост"s, "черный ошейник"s };
+    for (const string& query : queries) {
+        ASSERT_HINT(SameDocuments(search_server.FindTopDocuments(query), expected_server.FindTopDocuments(query)),
+                    query);
+        const auto expected = expected_server.FindTopDocuments(query, any_document);
+        ASSERT_HINT(SameDocuments(search_server.FindTopDocuments(query, any_document), expected), query);
+        ASSERT_HINT(SameDocuments(search_server.FindTopDocuments(execution::par, query, any_document), expected),
+                    query);
+    }
+}
+
+/*
+Частоты слов документа
+*/
+
+void TestWordFrequencies() {
+    SearchServer search_server("и в"s);
+    search_server.AddDocument(1, "белый кот и модный ошейник кот"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "пушистый кот"s, DocumentStatus::ACTUAL, { 2 });
+    search_server.AddDocument(3, "ухоженный пес"s, DocumentStatus::ACTUAL, { 3 });
+    search_server.RemoveDocument(2);
+    
+    // Со сборкой без прямого индекса частоты собираются из списков вхождений
+    map<string, double> frequencies;
+    for (const auto [word, term_freq] : search_server.GetWordFrequencies(1)) {
+        frequencies.emplace(string(word), term_freq);
+    }
+    const map<string, double> expected = { { "белый"s, 0.2 }, { "кот"s, 0.4 }, { "модный"s, 0.2 },
+                                           { "ошейник"s, 0.2 } };
+    ASSERT_EQUAL(frequencies.size(), expected.size());
+    for (const auto& [word, term_freq] : expected) {
+        ASSERT_HINT(frequencies.count(word) && abs(frequencies.at(word) - term_freq) < 1e-9, word);
+    }
+    
+    ASSERT_EQUAL(search_server.GetWordFrequencies(3).size(), 2u);
+    ASSERT(search_server.GetWordFrequencies(2).empty());
+    ASSERT(search_server.GetWordFrequencies(42).empty());
+}
+
+/*
+Тексты документов и бюджет памяти
+*/
+
+void TestDocumentContent() {
+    IndexOptions options;
+    options.memory_budget_bytes = 256 * 1024;
+    options.memory_budget_policy = MemoryBudgetPolicy::EVICT_CONTENT;
+    SearchServer search_server("и в на"s, options);
+    
+    // Длинные тексты занимают основную часть бюджета, поэтому старые из них будут освобождены
+    auto make_document = [](int document_id) {
+        return "кот номер "s + to_string(document_id % 10) + " "s + string(2000, 'x');
+    };
+    const int document_count = 300;
+    for (int document_id = 0; document_id < document_count; ++document_id) {
+        search_server.AddDocument(document_id, make_document(document_id), DocumentStatus::ACTUAL, { 1 });
+    }
+    
+    const int last_id = document_count - 1;
+    const auto last_content = search_server.GetDocumentContent(last_id);
+    ASSERT(last_content.has_value());
+    ASSERT_EQUAL(*last_content, make_document(last_id));
+    ASSERT_HINT(!search_server.GetDocumentContent(0).has_value(), "the oldest content must be evicted"s);
+    // Освобождается только текст: документ по-прежнему находится
+    ASSERT_EQUAL(search_server.FindTopDocuments("номер"s).size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+    
+    search_server.RemoveDocument(last_id);
+    try {
+        search_server.GetDocumentContent(last_id);
+        ASSERT_HINT(false, "content of a removed document must not be returned"s);
+    } catch (const out_of_range&) {
+    }
+}
+
+void TestMemoryBudget() {
+    IndexOptions options;
+    options.memory_budget_bytes = 1024 * 1024;
+    for (const bool store_positions : { false, true }) {
+        options.store_positions = store_positions;
+        SearchServer search_server(""s, options);
+        
+        // Оценка документа должна учитывать рост колонок и списков: фактический объем
+        // индекса не выходит за бюджет ни после одного добавления
+        int added = 0;
+        try {
+            for (int id = 0; id < 100'000; ++id) {
+                string document;
+                for (int word = 0; word < 20; ++word) {
+                    document += "w"s + to_string((id * 7 + word * 13) % 500) + " "s;
+                }
+                search_server.AddDocument(id, document, DocumentStatus::ACTUAL, { 1 });
+                ++added;
+                ASSERT(search_server.GetMemoryReport(0).TotalBytes() <= options.memory_budget_bytes);
+            }
+        } catch (const runtime_error&) {
+        }
+        ASSERT(added > 0);
+        ASSERT_EQUAL(search_server.GetDocumentCount(), static_cast<size_t>(added));
+    }
+}
+
+/*
+Параллельный словарь
+*/
+
+void TestConcurrentMapUpdates() {
+    // Минимальная начальная емкость: таблицы сегментов увеличиваются во время сложения
+    ConcurrentMap<int, double> map(4);
+    const int thread_count = 4;
+    // Нечетный множитель переставляет ключи по модулю степени двойки
+    const int key_count = 1 << 14;
+    vector<thread> threads;
+    for (int t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&map, t] {
+            for (int i = 0; i < key_count; ++i) {
+                // Потоки обходят ключи в разном порядке и конкурируют за одни и те же ячейки
+                map[(i * (2 * t + 1)) % key_count] += 1.0;
+            }
+        });
+    }
+    for (thread& worker : threads) {
+        worker.join();
+    }
+    
+    const auto result = map.BuildOrdinaryMap();
+    ASSERT_EQUAL(result.size(), static_cast<size_t>(key_count));
+    for (const auto& [key, value] : result) {
+        ASSERT_EQUAL_HINT(value, static_cast<double>(thread_count), "key "s + to_string(key));
+    }
+}
+
+void TestConcurrentMapEraseDuringGrow() {
+    ConcurrentMap<int, double> map(2);
+    const int thread_count = 4;
+    const int keys_per_thread = 20'000;
+    vector<thread> threads;
+    for (int t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&map, t] {
+            // Каждый поток вставляет свои ключи и удаляет каждый третий, пока другие потоки
+            // увеличивают таблицы тех же сегментов
+            for (int key = t * keys_per_thread; key < (t + 1) * keys_per_thread; ++key) {
+                map[key] += 1.0;
+                if (key % 3 == 0) {
+                    ASSERT_EQUAL(map.erase(key), static_cast<size_t>(1));
+                }
+            }
+        });
+    }
+    for (thread& worker : threads) {
+        worker.join();
+    }
+    
+    size_t item_count = 0;
+    map.ForEach(execution::seq, [&item_count](int key, double value) {
+        ASSERT(key % 3 != 0);
+        ASSERT_EQUAL(value, 1.0);
+        ++item_count;
+    });
+    const size_t total = static_cast<size_t>(thread_count) * keys_per_thread;
+    ASSERT_EQUAL(item_count, total - (total + 2) / 3);
+    ASSERT_EQUAL(map.erase(0), static_cast<size_t>(0));
+}
+
+/*
+Ранжирование по индексу вкладов
+*/
+
+namespace {
+
+// Индекс вкладов сравнивается с точным ранжированием на одном и том же потоке изменений
+void CheckImpactOrderedRanking(double idf_refresh_drift) {
+    CorpusConfig config;
+    config.vocabulary_size = 500;
+    config.max_document_words = 30;
+    ZipfCorpusGenerator generator(config);
+    const vector<string> queries = generator.GenerateQueries(50);
+    
+    IndexOptions options;
+    options.engine = RankingEngine::IMPACT_ORDERED;
+    options.idf_refresh_drift = idf_refresh_drift;
+    SearchServer exact(""s);
+    SearchServer impact(""s, options);
+    
+    // Запросы чередуются с добавлением и удалением, чтобы индекс вкладов сливал накопленные изменения
+    const int document_count = 3000;
+    int checked = 0;
+    for (int id = 0; id < document_count; ++id) {
+        const string document = generator.GenerateDocument();
+        exact.AddDocument(id, document, DocumentStatus::ACTUAL, { id % 5 });
+        impact.AddDocument(id, document, DocumentStatus::ACTUAL, { id % 5 });
+        if (id % 3 == 2) {
+            exact.RemoveDocument(id - 1);
+            impact.RemoveDocument(id - 1);
+        }
+        if (id % 50 != 0) {
+            continue;
+        }
+        const string& query = queries[(id / 50) % queries.size()];
+        const auto expected = exact.FindTopDocuments(query);
+        const auto seq_documents = impact.FindTopDocuments(query);
+        const auto par_documents = impact.FindTopDocuments(execution::par, query);
+        for (const auto* documents : { &seq_documents, &par_documents }) {
+            ASSERT_EQUAL_HINT(documents->size(), expected.size(), query);
+            for (size_t i = 0; i < expected.size(); ++i) {
+                ASSERT_EQUAL_HINT((*documents)[i].id, expected[i].id, query);
+                ASSERT_HINT(abs((*documents)[i].relevance - expected[i].relevance) < 1e-9, query);
+            }
+        }
+        ++checked;
+    }
+    ASSERT_EQUAL(checked, document_count / 50);
+}
+
+} // namespace
+
+void TestImpactOrderedRanking() {
+    CheckImpactOrderedRanking(0.0);
+}
+
+void TestImpactOrderedRankingWithDrift() {
+    // Кешированный IDF отстает от числа документов, но итоговая релевантность считается по точному
+    CheckImpactOrderedRanking(IndexOptions().idf_refresh_drift);
+    CheckImpactOrderedRanking(0.2);
+}
+
+void TestImpactOrderedSingleDocument() {
+    // У слов единственного документа IDF равен нулю: поиск должен завершиться с этим документом
+    IndexOptions options;
+    options.engine = RankingEngine::IMPACT_ORDERED;
+    SearchServer search_server(""s, options);
+    search_server.AddDocument(1, "кот пушистый"s, DocumentStatus::ACTUAL, { 1 });
+    const auto documents = search_server.FindTopDocuments("кот пушистый"s);
+    ASSERT_EQUAL(documents.size(), 1u);
+    ASSERT_EQUAL(documents[0].id, 1);
+    
+    search_server.RemoveDocument(1);
+    ASSERT(search_server.FindTopDocuments("кот"s).empty());
+}
+
+/*
+Фразовые запросы
+*/
+
+void TestPhraseQueries() {
+    IndexOptions options;
+    options.store_positions = true;
+    SearchServer search_server("и в на"s, options);
+    search_server.AddDocument(1, "белый кот и модный ошейник"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "кот белый"s, DocumentStatus::ACTUAL, { 2 });
+    search_server.AddDocument(3, "белый пес и кот"s, DocumentStatus::ACTUAL, { 3 });
+    
+    // Слова фразы должны идти подряд и в том же порядке
+    {
+        const auto documents = search_server.FindTopDocuments("\"белый кот\""s);
+        ASSERT_EQUAL(documents.size(), 1u);
+        ASSERT_EQUAL(documents[0].id, 1);
+        const auto par_documents = search_server.FindTopDocuments(execution::par, "\"белый кот\""s);
+        ASSERT_EQUAL(par_documents.size(), 1u);
+        ASSERT_EQUAL(par_documents[0].id, 1);
+        
+        const auto [words, status] = search_server.MatchDocument("\"белый кот\""s, 2);
+        ASSERT(words.empty());
+        const auto [matched_words, matched_status] = search_server.MatchDocument("\"белый кот\""s, 1);
+        ASSERT_EQUAL(matched_words.size(), 2u);
+    }
+    
+    // Стоп-слово внутри фразы занимает позицию, но может быть любым словом
+    {
+        const auto documents = search_server.FindTopDocuments("\"кот в модный\""s);
+        ASSERT_EQUAL(documents.size(), 1u);
+        ASSERT_EQUAL(documents[0].id, 1);
+        ASSERT(search_server.FindTopDocuments("\"кот модный\""s).empty());
+    }
+    
+    // Фраза вместе с обычными и минус-словами
+    {
+        const auto documents = search_server.FindTopDocuments("\"белый кот\" пес"s);
+        ASSERT_EQUAL(documents.size(), 1u);
+        ASSERT(search_server.FindTopDocuments("\"белый кот\" -ошейник"s).empty());
+    }
+    
+    // Удаленный документ не находится по фразе
+    search_server.RemoveDocument(1);
+    ASSERT(search_server.FindTopDocuments("\"белый кот\""s).empty());
+    
+    // Незакрытая кавычка и минус-слово внутри фразы - ошибки запроса
+    for (const string& query : { "\"белый кот"s, "\"-белый кот\""s, "\"\""s }) {
+        try {
+            search_server.FindTopDocuments(query);
+            ASSERT_HINT(false, query);
+        } catch (const invalid_argument&) {
+        }
+    }
+}
+
+void TestQuotesWithoutPositions() {
+    // Без позиций кавычка - обычный символ слова, а не граница фразы
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "\"кот\" пушистый"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "пушистый кот"s, DocumentStatus::ACTUAL, { 2 });
+    
+    const auto documents = search_server.FindTopDocuments("\"кот\""s);
+    ASSERT_EQUAL(documents.size(), 1u);
+    ASSERT_EQUAL(documents[0].id, 1);
+    ASSERT(search_server.FindTopDocuments("\"пушистый кот"s).size() == 1u);
+    ASSERT(search_server.FindTopDocuments("\"пушистый"s).empty());
+}
+
+/*
+Словарь терминов и префиксные запросы
+*/
+
+void TestTermDictionary() {
+    TermDictionary dictionary;
+    ASSERT(!dictionary.Find("кот"s).has_value());
+    
+    // Достаточно терминов, чтобы хеш-таблица и блоки текстов несколько раз выросли
+    const int term_count = 100'000;
+    vector<string_view> first_views;
+    for (int i = 0; i < term_count; ++i) {
+        const uint32_t id = dictionary.Insert("термин"s + to_string(i));
+        ASSERT_EQUAL(id, static_cast<uint32_t>(i));
+        if (i < 100) {
+            first_views.push_back(dictionary.GetTerm(id));
+        }
+    }
+    ASSERT_EQUAL(dictionary.Size(), static_cast<size_t>(term_count));
+    
+    for (int i = 0; i < term_count; ++i) {
+        const string term = "термин"s + to_string(i);
+        ASSERT_EQUAL(dictionary.Insert(term), static_cast<uint32_t>(i));
+        const auto id = dictionary.Find(term);
+        ASSERT(id.has_value());
+        ASSERT_EQUAL(*id, static_cast<uint32_t>(i));
+        ASSERT_EQUAL(dictionary.GetTerm(*id), term);
+    }
+    ASSERT(!dictionary.Find("термин"s).has_value());
+    ASSERT(!dictionary.Find("термин"s + to_string(term_count)).has_value());
+    
+    // Тексты терминов не перемещаются при росте словаря
+    for (size_t i = 0; i < first_views.size(); ++i) {
+        ASSERT_EQUAL(first_views[i], "термин"s + to_string(i));
+    }
+}
+
+void TestTermDictionaryOrder() {
+    // Слова из короткого алфавита часто делят префиксы; проверки идут между вставками,
+    // так что часть терминов еще в неупорядоченном хвосте, а часть уже влита в блоки
+    mt19937 generator(17);
+    TermDictionary dictionary;
+    set<string> expected;
+    auto collect = [&dictionary](string_view prefix) {
+        vector<string> terms;
+        dictionary.ForEachWithPrefix(prefix, [&](uint32_t id) {
+            terms.emplace_back(dictionary.GetTerm(id));
+            return true;
+        });
+        return terms;
+    };
+    for (int i = 0; i < 5000; ++i) {
+        string word(uniform_int_distribution<int>(1, 8)(generator), 'a');
+        for (char& c : word) {
+            c = static_cast<char>('a' + uniform_int_distribution<int>(0, 3)(generator));
+        }
+        dictionary.Insert(word);
+        expected.insert(word);
+        if (i % 250 != 0 && i != 4999) {
+            continue;
+        }
+        for (const string& prefix : { ""s, "a"s, "ab"s, "dcb"s, "bbbb"s, word, word + "a"s, "e"s }) {
+            vector<string> terms;
+            for (auto it = expected.lower_bound(prefix); it != expected.end() && it->rfind(prefix, 0) == 0; ++it) {
+                terms.push_back(*it);
+            }
+            ASSERT_HINT(collect(prefix) == terms, prefix);
+        }
+    }
+    
+    // Обход останавливается, когда обработчик возвращает false
+    size_t visited = 0;
+    dictionary.ForEachWithPrefix("a"s, [&visited](uint32_t) {
+        return ++visited < 10;
+    });
+    ASSERT_EQUAL(visited, 10u);
+    
+    TermDictionary empty;
+    empty.ForEachWithPrefix(""s, [](uint32_t) {
+        ASSERT(false);
+        return true;
+    });
+}
+
+void TestPrefixExpansion() {
+    IndexOptions options;
+    options.max_prefix_expansions = 2;
+    SearchServer search_server("и в на"s, options);
+    search_server.AddDocument(1, "кот котенок"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "пес котлета"s, DocumentStatus::ACTUAL, { 2 });
+    search_server.AddDocument(3, "пес"s, DocumentStatus::ACTUAL, { 3 });
+    search_server.AddDocument(4, "котик"s, DocumentStatus::ACTUAL, { 4 });
+    search_server.AddDocument(5, "котлета"s, DocumentStatus::ACTUAL, { 5 });
+    search_server.RemoveDocument(5);
+    
+    // Ранжирование использует первые по алфавиту слова: кот и котенок
+    {
+        const auto [words, status] = search_server.MatchDocument("кот*"s, 1);
+        ASSERT_EQUAL(words.size(), static_cast<size_t>(2));
+        const auto documents = search_server.FindTopDocuments("кот*"s);
+        ASSERT_EQUAL(documents.size(), static_cast<size_t>(1));
+        ASSERT_EQUAL(documents[0].id, 1);
+    }
+    
+    // Минус-префикс исключает документы по всем своим словам, в том числе за пределами ограничения
+    {
+        const auto documents = search_server.FindTopDocuments("пес -кот*"s);
+        ASSERT_EQUAL(documents.size(), static_cast<size_t>(1));
+        ASSERT_EQUAL(documents[0].id, 3);
+        const auto [words, status] = search_server.MatchDocument("пес -кот*"s, 2);
+        ASSERT(words.empty());
+    }
+    
+    // Обязательный префикс отбирает документы по всем своим словам
+    {
+        const auto documents = search_server.FindTopDocuments("+кот*"s);
+        ASSERT_EQUAL(documents.size(), static_cast<size_t>(3));
+        const auto matched = search_server.MatchDocuments("+кот*"s, { 1, 2, 3, 4 });
+        ASSERT(!matched.GetWords(0).empty());
+        ASSERT(matched.GetWords(2).empty());
+    }
+    
+    // Слова только удаленных документов не раскрываются
+    {
+        const auto documents = search_server.FindTopDocuments("+котл*"s);
+        ASSERT_EQUAL(documents.size(), static_cast<size_t>(1));
+        ASSERT_EQUAL(documents[0].id, 2);
+    }
+}
+
+/*
+Пересечение отсортированных списков
+*/
+
+namespace {
+
+// Отсортированный массив без повторов: каждое число из [0, range) берется с вероятностью size / range
+vector<int> MakeSortedList(mt19937& generator, int size, int range) {
+    vector<int> values;
+    uniform_int_distribution<int> distribution(0, range - 1);
+    for (int value = 0; value < range; ++value) {
+        if (distribution(generator) < size) {
+            values.push_back(value);
+        }
+    }
+    return values;
+}
+
+} // namespace
+
+void TestIntersectSorted() {
+    mt19937 generator(42);
+    // Сопоставимые длины (поблочное сравнение), сильно различающиеся (галоп в обе стороны) и пустые
+    const vector<pair<int, int>> sizes = {
+        { 0, 100 }, { 100, 0 }, { 1, 1 }, { 3, 5 }, { 7, 9 }, { 100, 120 }, { 1000, 1000 },
+        { 5, 5000 }, { 5000, 5 }, { 40, 4000 }, { 4000, 40 }, { 1, 10000 },
+    };
+    const int range = 10'000;
+    for (const auto& [lhs_size, rhs_size] : sizes) {
+        for (int round = 0; round < 5; ++round) {
+            const vector<int> lhs = MakeSortedList(generator, lhs_size, range);
+            const vector<int> rhs = MakeSortedList(generator, rhs_size, range);
+            vector<int> expected;
+            set_intersection(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), back_inserter(expected));
+            const string hint = to_string(lhs.size()) + " x "s + to_string(rhs.size());
+            
+            vector<int> out(min(lhs.size(), rhs.size()));
+            out.resize(IntersectSorted(lhs.data(), lhs.size(), rhs.data(), rhs.size(), out.data()));
+            ASSERT_HINT(out == expected, hint);
+            
+            // Результат на месте левого массива
+            vector<int> in_place = lhs;
+            in_place.resize(IntersectSorted(in_place.data(), in_place.size(), rhs.data(), rhs.size(),
+                                            in_place.data()));
+            ASSERT_HINT(in_place == expected, hint + " in place"s);
+        }
+    }
+    
+    // Совпадающие массивы и массивы без общих элементов
+    vector<int> evens;
+    vector<int> odds;
+    for (int i = 0; i < 1000; ++i) {
+        (i % 2 == 0 ? evens : odds).push_back(i);
+    }
+    vector<int> out(evens.size());
+    ASSERT_EQUAL(IntersectSorted(evens.data(), evens.size(), odds.data(), odds.size(), out.data()), 0u);
+    out.resize(IntersectSorted(evens.data(), evens.size(), evens.data(), evens.size(), out.data()));
+    ASSERT(out == evens);
+}
+
+void TestGallopLowerBound() {
+    mt19937 generator(7);
+    const vector<int> values = MakeSortedList(generator, 500, 5000);
+    for (int value = -1; value <= 5001; ++value) {
+        const auto expected = lower_bound(values.begin(), values.end(), value);
+        const int* found = GallopLowerBound(values.data(), values.data() + values.size(), value);
+        ASSERT_EQUAL(found - values.data(), expected - values.begin());
+    }
+    const int* empty = values.data();
+    ASSERT(GallopLowerBound(empty, empty, 0) == empty);
+}
+
+/*
+Пакетная обработка команд
+*/
+
+namespace {
+
+// Строка вывода RunBatch для результата запроса
+string FormatQueryLine(size_t line, const vector<Document>& documents) {
+    char buffer[32];
+    string output = to_string(line) + "\t"s;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        if (i > 0) {
+            output += ' ';
+        }
+        output += to_string(documents[i].id) + ':';
+        const auto [end, error] = to_chars(buffer, buffer + sizeof(buffer), documents[i].relevance);
+        output.append(buffer, end);
+    }
+    return output;
+}
+
+} // namespace
+
+void TestBatchProcessor() {
+    // Команды чередуются так, чтобы серии запросов шли между изменениями индекса;
+    // ожидаемый вывод получается последовательным выполнением тех же команд
+    const vector<string> documents = MakeFilterDocuments(60);
+    vector<string> lines = { "# пакет для теста"s, ""s };
+    for (int id = 0; id < static_cast<int>(documents.size()); ++id) {
+        lines.push_back("add "s + to_string(id) + " actual "s + to_string(RatingForTest(id)) + " "s + documents[id]);
+        if (id % 7 == 3) {
+            lines.push_back("query кот -пес"s);
+            lines.push_back("query белый модный"s);
+            lines.push_back("query черный -хвост ошейник"s);
+        }
+        if (id % 11 == 10) {
+            lines.push_back("remove "s + to_string(id - 5));
+            lines.push_back("query кот пес хвост"s);
+        }
+    }
+    const vector<string> invalid_lines = { "add 1 actual 5 повторный ID"s, "remove 1000"s, "add x actual - кот"s,
+                                           "add 2000 unknown - кот"s, "unknown command"s, "query --кот"s };
+    lines.insert(lines.begin() + 20, invalid_lines.begin(), invalid_lines.end());
+    lines.push_back("query кот"s);
+    
+    SearchServer expected_server("и в на"s);
+    vector<string> expected;
+    vector<size_t> error_lines;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        const string& line = lines[i];
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        try {
+            const BatchCommand command = ParseBatchCommand(line, i + 1);
+            if (command.type == BatchCommandType::ADD) {
+                expected_server.AddDocument(command.document_id, command.text, command.status, command.ratings);
+            } else if (command.type == BatchCommandType::REMOVE) {
+                expected_server.RemoveDocument(command.document_id);
+            } else {
+                expected.push_back(FormatQueryLine(i + 1, expected_server.FindTopDocuments(command.text)));
+            }
+        } catch (const exception& e) {
+            expected.push_back(to_string(i + 1) + "\terror: "s + e.what());
+            error_lines.push_back(i + 1);
+        }
+    }
+    ASSERT_EQUAL(error_lines.size(), invalid_lines.size());
+    
+    string text;
+    for (const string& line : lines) {
+        text += line + "\n"s;
+    }
+    // Маленькие блоки разбивают серии запросов между несколькими блоками конвейера
+    for (const size_t block_size : { size_t(64), size_t(1000), LineBlockReader::DEFAULT_BLOCK_SIZE }) {
+        unique_ptr<FILE, int (*)(FILE*)> input(tmpfile(), &fclose);
+        unique_ptr<FILE, int (*)(FILE*)> output(tmpfile(), &fclose);
+        ASSERT(input && output);
+        ASSERT_EQUAL(fwrite(text.data(), 1, text.size(), input.get()), text.size());
+        rewind(input.get());
+        
+        SearchServer search_server("и в на"s);
+        BatchConfig config;
+        config.block_size = block_size;
+        config.queue_depth = 2;
+        const BatchStats stats = RunBatch(search_server, input.get(), output.get(), config);
+        ASSERT_EQUAL(stats.lines, lines.size());
+        ASSERT_EQUAL(stats.errors, invalid_lines.size());
+        
+        rewind(output.get());
+        vector<string> actual;
+        char buffer[4096];
+        string current;
+        while (fgets(buffer, sizeof(buffer), output.get()) != nullptr) {
+            current += buffer;
+            if (!current.empty() && current.back() == '\n') {
+                current.pop_back();
+                actual.push_back(move(current));
+                current.clear();
+            }
+        }
+        const string hint = "block size "s + to_string(block_size);
+        ASSERT_EQUAL_HINT(actual.size(), expected.size(), hint);
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQUAL_HINT(actual[i], expected[i], hint);
+        }
+        ASSERT_EQUAL(search_server.GetDocumentCount(), expected_server.GetDocumentCount());
+    }
+}
+
+void TestSearchServer() {
+    RUN_TEST(TestRequestQueueWindows);
+    RUN_TEST(TestRequestQueueExpiration);
+    RUN_TEST(TestPrometheusFormat);
+    RUN_TEST(TestTraceRing);
+    RUN_TEST(TestTraceSampling);
+    RUN_TEST(TestCursorPagination);
+    RUN_TEST(TestCursorAtRemovedDocument);
+    RUN_TEST(TestStatusPushdown);
+    RUN_TEST(TestMinusWordExclusion);
+    RUN_TEST(TestMatchDocumentsBatch);
+    RUN_TEST(TestPostingListErase);
+    RUN_TEST(TestRemovalBeforeCompaction);
+    RUN_TEST(TestWordFrequencies);
+    RUN_TEST(TestDocumentContent);
+    RUN_TEST(TestMemoryBudget);
+    RUN_TEST(TestConcurrentMapUpdates);
+    RUN_TEST(TestConcurrentMapEraseDuringGrow);
+    RUN_TEST(TestIntersectSorted);
+    RUN_TEST(TestGallopLowerBound);
+    RUN_TEST(TestBatchProcessor);
+    RUN_TEST(TestImpactOrderedRanking);
+    RUN_TEST(TestImpactOrderedRankingWithDrift);
+    RUN_TEST(TestImpactOrderedSingleDocument);
+    RUN_TEST(TestPhraseQueries);
+    RUN_TEST(TestQuotesWithoutPositions);
+    RUN_TEST(TestTermDictionary);
+    RUN_TEST(TestTermDictionaryOrder);
+    RUN_TEST(TestPrefixExpansion);
+}
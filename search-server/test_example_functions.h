@@ -1 +1,107 @@
-#pragma once
\ No newline at end of file
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+using std::literals::string_literals::operator""s;
+
+/*
+Модульные тесты поисковой системы: search-server test.
+Проверка, не прошедшая ASSERT/ASSERT_EQUAL, печатает место и выражение и завершает программу
+*/
+
+template <typename T, typename U>
+void AssertEqualImpl(const T& t, const U& u, const std::string& t_str, const std::string& u_str,
+                     const std::string& file, const std::string& func, unsigned line, const std::string& hint) {
+    if (t != u) {
+        std::cerr << std::boolalpha;
+        std::cerr << file << "("s << line << "): "s << func << ": "s;
+        std::cerr << "ASSERT_EQUAL("s << t_str << ", "s << u_str << ") failed: "s;
+        std::cerr << t << " != "s << u << "."s;
+        if (!hint.empty()) {
+            std::cerr << " Hint: "s << hint;
+        }
+        std::cerr << std::endl;
+        std::abort();
+    }
+}
+
+void AssertImpl(bool value, const std::string& expr_str, const std::string& file, const std::string& func,
+                unsigned line, const std::string& hint);
+
+#define ASSERT_EQUAL(a, b) AssertEqualImpl((a), (b), #a, #b, __FILE__, __FUNCTION__, __LINE__, ""s)
+#define ASSERT_EQUAL_HINT(a, b, hint) AssertEqualImpl((a), (b), #a, #b, __FILE__, __FUNCTION__, __LINE__, (hint))
+#define ASSERT(expr) AssertImpl(!!(expr), #expr, __FILE__, __FUNCTION__, __LINE__, ""s)
+#define ASSERT_HINT(expr, hint) AssertImpl(!!(expr), #expr, __FILE__, __FUNCTION__, __LINE__, (hint))
+
+template <typename TestFunc>
+void RunTestImpl(const TestFunc& func, const std::string& test_name) {
+    func();
+    std::cerr << test_name << " OK"s << std::endl;
+}
+
+#define RUN_TEST(func) RunTestImpl(func, #func)
+
+// Очередь запросов
+void TestRequestQueueWindows();
+void TestRequestQueueExpiration();
+
+// Метрики
+void TestPrometheusFormat();
+
+// Трассировка
+void TestTraceRing();
+void TestTraceSampling();
+
+// Постраничная выдача по курсору
+void TestCursorPagination();
+void TestCursorAtRemovedDocument();
+
+// Фильтр по статусу и рейтингу
+void TestStatusPushdown();
+
+// Исключение документов по минус-словам
+void TestMinusWordExclusion();
+
+// Пакетное сопоставление документов с запросом
+void TestMatchDocumentsBatch();
+
+// Удаление документов до перенумерации
+void TestPostingListErase();
+void TestRemovalBeforeCompaction();
+
+// Частоты слов документа
+void TestWordFrequencies();
+
+// Тексты документов и бюджет памяти
+void TestDocumentContent();
+void TestMemoryBudget();
+
+// Параллельный словарь
+void TestConcurrentMapUpdates();
+void TestConcurrentMapEraseDuringGrow();
+
+// Ранжирование по индексу вкладов
+void TestImpactOrderedRanking();
+void TestImpactOrderedRankingWithDrift();
+void TestImpactOrderedSingleDocument();
+
+// Фразовые запросы
+void TestPhraseQueries();
+void TestQuotesWithoutPositions();
+
+// Словарь терминов и префиксные запросы
+void TestTermDictionary();
+void TestTermDictionaryOrder();
+void TestPrefixExpansion();
+
+// Пересечение отсортированных списков
+void TestIntersectSorted();
+void TestGallopLowerBound();
+
+// Пакетная обработка команд
+void TestBatchProcessor();
+
+// Запуск всех тестов
+void TestSearchServer();
@@ -0,0 +1,177 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using std::literals::string_literals::operator""s;
+
+namespace {
+
+thread_local uint64_t current_trace_id = 0;
+thread_local uint32_t sample_countdown = 0;
+
+uint32_t CurrentThreadNumber() {
+    static std::atomic<uint32_t> next_thread{ 1 };
+    thread_local const uint32_t thread_number = next_thread.fetch_add(1, std::memory_order_relaxed);
+    return thread_number;
+}
+
+} // namespace
+
+/*
+Реализация Tracer
+*/
+
+std::atomic<uint32_t> Tracer::sample_every_{ 0 };
+
+Tracer::Tracer(size_t capacity) : capacity_(std::max<size_t>(1, capacity)) {}
+
+Tracer& Tracer::Instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+void Tracer::SetSampling(uint32_t every_nth) {
+    // Буфер выделяется заранее, чтобы первый трассируемый запрос не платил за это
+    if (every_nth != 0) {
+        Instance().GetRing();
+    }
+    sample_every_.store(every_nth, std::memory_order_relaxed);
+}
+
+Tracer::Slot* Tracer::GetRing() {
+    std::call_once(ring_once_, [this] {
+        ring_storage_ = std::make_unique<Slot[]>(capacity_);
+        ring_.store(ring_storage_.get(), std::memory_order_release);
+    });
+    return ring_.load(std::memory_order_acquire);
+}
+
+bool Tracer::ShouldSample() {
+    const uint32_t every_nth = sample_every_.load(std::memory_order_relaxed);
+    if (every_nth == 0) {
+        return false;
+    }
+    // Счетчик свой у каждого потока, чтобы сэмплирование не создавало общей точки конкуренции
+    if (sample_countdown == 0 || sample_countdown > every_nth) {
+        sample_countdown = every_nth;
+    }
+    return --sample_countdown == 0;
+}
+
+void Tracer::Record(const TraceEvent& event) {
+    Slot* const ring = GetRing();
+    const uint64_t index = write_index_.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = ring[index % capacity_];
+
+    std::array<uint64_t, EVENT_WORDS> words{};
+    std::memcpy(words.data(), &event, sizeof(TraceEvent));
+
+    slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < EVENT_WORDS; ++i) {
+        slot.words[i].store(words[i], std::memory_order_relaxed);
+    }
+    slot.sequence.store(2 * index + 2, std::memory_order_release);
+}
+
+std::vector<TraceEvent> Tracer::Collect() const {
+    const Slot* const ring = ring_.load(std::memory_order_acquire);
+    if (ring == nullptr) {
+        return {};
+    }
+    const uint64_t end = write_index_.load(std::memory_order_acquire);
+    const uint64_t begin = end > capacity_ ? end - capacity_ : 0;
+
+    std::vector<TraceEvent> events;
+    events.reserve(end - begin);
+    std::array<uint64_t, EVENT_WORDS> words{};
+    for (uint64_t index = begin; index < end; ++index) {
+        const Slot& slot = ring[index % capacity_];
+        // Слот, который в этот момент перезаписывается или ещё не дописан, пропускаем
+        if (slot.sequence.load(std::memory_order_acquire) != 2 * index + 2) {
+            continue;
+        }
+        for (size_t i = 0; i < EVENT_WORDS; ++i) {
+            words[i] = slot.words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) == 2 * index + 2) {
+            TraceEvent& event = events.emplace_back();
+            std::memcpy(static_cast<void*>(&event), words.data(), sizeof(TraceEvent));
+        }
+    }
+    return events;
+}
+
+void Tracer::WriteChromeTrace(std::ostream& out) const {
+    const auto precision = out.precision(15);
+
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":["s;
+    bool first = true;
+    for (const TraceEvent& event : Collect()) {
+        if (!first) {
+            out << ","s;
+        }
+        first = false;
+
+        // Время в формате trace-event задается в микросекундах
+        out << "\n{\"name\":\""s << event.name << "\",\"cat\":\"search\",\"ph\":\"X\",\"pid\":1"s
+            << ",\"tid\":"s << event.thread_id
+            << ",\"ts\":"s << event.start_ns / 1000.0
+            << ",\"dur\":"s << event.duration_ns / 1000.0
+            << ",\"args\":{\"trace_id\":"s << event.trace_id;
+        for (size_t i = 0; i < event.counter_count; ++i) {
+            out << ",\""s << event.counters[i].name << "\":"s << event.counters[i].value;
+        }
+        out << "}}"s;
+    }
+    out << "\n]}\n"s;
+
+    out.precision(precision);
+}
+
+void Tracer::DumpChromeTrace(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("Cannot open trace file "s + path);
+    }
+    WriteChromeTrace(out);
+}
+
+/*
+Реализация TraceSpan
+*/
+
+TraceSpan::TraceSpan(const char* name, bool root) {
+    if (current_trace_id == 0) {
+        if (!root || !Tracer::ShouldSample()) {
+            return;
+        }
+        current_trace_id = Tracer::Instance().NextTraceId();
+        owns_trace_ = true;
+    }
+
+    active_ = true;
+    event_.name = name;
+    event_.trace_id = current_trace_id;
+    event_.thread_id = CurrentThreadNumber();
+    event_.start_ns = Tracer::Instance().NowNs();
+}
+
+TraceSpan::~TraceSpan() {
+    if (!active_) {
+        return;
+    }
+    event_.duration_ns = Tracer::Instance().NowNs() - event_.start_ns;
+    Tracer::Instance().Record(event_);
+    if (owns_trace_) {
+        current_trace_id = 0;
+    }
+}
+
+uint64_t TraceSpan::CurrentTraceId() {
+    return current_trace_id;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Максимальное количество счетчиков в одном спане
+constexpr size_t TRACE_MAX_COUNTERS = 6;
+// Размер кольцевого буфера спанов по умолчанию
+constexpr size_t TRACE_DEFAULT_CAPACITY = 1 << 16;
+
+struct TraceCounter {
+    const char* name = nullptr;
+    int64_t value = 0;
+};
+
+/*
+Завершенный спан. Имена спанов и счетчиков должны быть строковыми литералами:
+буфер хранит только указатели на них
+*/
+
+struct TraceEvent {
+    const char* name = nullptr;
+    uint64_t trace_id = 0;
+    uint32_t thread_id = 0;
+    // Наносекунды от создания трассировщика
+    int64_t start_ns = 0;
+    int64_t duration_ns = 0;
+    size_t counter_count = 0;
+    std::array<TraceCounter, TRACE_MAX_COUNTERS> counters{};
+};
+
+// Буфер копирует спаны побайтно
+static_assert(std::is_trivially_copyable_v<TraceEvent>);
+
+/*
+Трассировщик запросов с сэмплированием.
+Спаны записываются в кольцевой буфер без блокировок: при переполнении
+старые спаны перезаписываются новыми. Буфер выделяется при первой записи или включении
+сэмплирования, поэтому процесс, в котором трассировка не включалась, за него не платит
+*/
+
+class Tracer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit Tracer(size_t capacity = TRACE_DEFAULT_CAPACITY);
+
+    static Tracer& Instance();
+
+    // Трассируется каждый every_nth корневой спан потока, 0 - трассировка выключена.
+    // Частота общая для процесса и хранится вне Instance(), чтобы проверка не создавала трассировщик
+    static void SetSampling(uint32_t every_nth);
+
+    static bool IsEnabled() {
+        return sample_every_.load(std::memory_order_relaxed) != 0;
+    }
+
+    // Решение о трассировке нового запроса в текущем потоке
+    static bool ShouldSample();
+
+    uint64_t NextTraceId() {
+        return next_trace_id_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    int64_t NowNs() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch_).count();
+    }
+
+    void Record(const TraceEvent& event);
+
+    // Согласованные спаны из буфера в порядке записи
+    std::vector<TraceEvent> Collect() const;
+
+    // Формат trace-event JSON (chrome://tracing, Perfetto)
+    void WriteChromeTrace(std::ostream& out) const;
+
+    void DumpChromeTrace(const std::string& path) const;
+
+private:
+    static constexpr size_t EVENT_WORDS = (sizeof(TraceEvent) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    // Слот защищен счетчиком версий (seqlock): нечетное значение - идет запись.
+    // Спан хранится словами в атомиках, поэтому чтение во время записи не гонка данных,
+    // а прочитанную вперемешку копию отбрасывает повторная проверка версии
+    struct Slot {
+        std::atomic<uint64_t> sequence{ 0 };
+        std::array<std::atomic<uint64_t>, EVENT_WORDS> words{};
+    };
+
+    static std::atomic<uint32_t> sample_every_;
+
+    const Clock::time_point epoch_ = Clock::now();
+    const size_t capacity_;
+    std::atomic<uint64_t> next_trace_id_{ 1 };
+    std::atomic<uint64_t> write_index_{ 0 };
+    std::once_flag ring_once_;
+    std::unique_ptr<Slot[]> ring_storage_;
+    // Опубликованный буфер; nullptr - в буфер ещё ничего не записывалось
+    std::atomic<Slot*> ring_{ nullptr };
+
+    Slot* GetRing();
+};
+
+/*
+Спан области видимости.
+Корневой спан (root = true) принимает решение о сэмплировании запроса,
+вложенные спаны того же потока записываются, только если запрос трассируется.
+При выключенной трассировке конструктор сводится к одной проверке флага
+*/
+
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name, bool root = false);
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    ~TraceSpan();
+
+    bool IsActive() const {
+        return active_;
+    }
+
+    void AddCounter(const char* name, int64_t value) {
+        if (active_ && event_.counter_count < TRACE_MAX_COUNTERS) {
+            event_.counters[event_.counter_count++] = TraceCounter{ name, value };
+        }
+    }
+
+    // Идентификатор трассы текущего потока (0 - поток сейчас не трассируется)
+    static uint64_t CurrentTraceId();
+
+private:
+    bool active_ = false;
+    bool owns_trace_ = false;
+    TraceEvent event_;
+};